@@ -1,6 +1,7 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
@@ -20,11 +21,32 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If true, stop the periodic timer interrupt while idle.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles in one timer tick, and the most ticks that fit in
+   the PIT's 16-bit one-shot countdown. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define ONESHOT_MAX_TICKS (UINT16_MAX / TICK_CYCLES)
+
+/* Number of ticks covered by the one-shot countdown started by
+   timer_idle_enter(), or 0 while the timer is periodic. */
+static int64_t oneshot_ticks;
+
+/* List of threads blocked in timer_sleep(), ordered by
+   increasing wake-up tick.  Only the timer interrupt handler
+   removes threads from it, so it is protected by disabling
+   interrupts. */
+static struct list sleep_list;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static list_less_func wakeup_less;
+static void resume_periodic (int64_t skipped);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -36,6 +58,7 @@ void
 timer_init (void) 
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  list_init (&sleep_list);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -85,15 +108,27 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The current thread is blocked and put on sleep_list, from
+   which timer_interrupt() wakes it once its wake-up tick has
+   passed, so sleeping threads take no time away from runnable
+   ones. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -159,6 +194,120 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  In tickless mode, replaces the periodic
+   timer interrupt with a single interrupt at the next timed
+   wake-up, so that an idle CPU is not woken once per tick for
+   nothing.  The PIT's 16-bit counter limits the countdown to
+   ONESHOT_MAX_TICKS, after which the idle thread simply halts
+   again.  Under the MLFQS, the countdown also stops at the next
+   whole second so that the load average is updated on time.
+   The countdown starts from the periodic timer's current count,
+   so that it ends exactly where the periodic interrupt would
+   have occurred.
+
+   timer_idle_exit() or the next timer interrupt, whichever
+   comes first, restores the periodic interrupt and catches
+   `ticks' up with the time that passed. */
+void
+timer_idle_enter (void) 
+{
+  int64_t cnt;
+  uint16_t phase;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  if (list_empty (&sleep_list))
+    cnt = ONESHOT_MAX_TICKS;
+  else
+    cnt = list_entry (list_front (&sleep_list),
+                      struct thread, elem)->wakeup_tick - ticks;
+  if (thread_mlfqs && cnt > TIMER_FREQ - ticks % TIMER_FREQ)
+    cnt = TIMER_FREQ - ticks % TIMER_FREQ;
+  if (cnt > ONESHOT_MAX_TICKS)
+    cnt = ONESHOT_MAX_TICKS;
+
+  /* Not worth it for a single tick. */
+  if (cnt < 2)
+    return;
+
+  /* PIT cycles left until the next periodic interrupt. */
+  phase = pit_read_count (0, &expired);
+  if (phase == 0 || phase > TICK_CYCLES)
+    phase = TICK_CYCLES;
+
+  pit_configure_oneshot (0, (cnt - 1) * TICK_CYCLES + phase);
+  oneshot_ticks = cnt;
+}
+
+/* Called by the scheduler, with interrupts off, whenever the
+   idle thread stops running.  If a one-shot countdown is in
+   progress, credits the whole ticks that have passed.  If the
+   countdown has already expired, its interrupt is still pending
+   and will account for the final tick and restore the periodic
+   timer interrupt itself.
+
+   Otherwise, the current tick is partly over.  Restarting the
+   periodic interrupt now would lose that part, and `ticks'
+   would fall behind a little on every early wake-up, so
+   instead the countdown is cut short to end at the next tick
+   boundary, whose interrupt restores the periodic timer. */
+void
+timer_idle_exit (void) 
+{
+  uint16_t remaining;
+  int64_t left;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+
+  remaining = pit_read_count (0, &expired);
+  if (expired)
+    {
+      resume_periodic (oneshot_ticks - 1);
+      return;
+    }
+
+  /* Tick boundaries still ahead, the last being the end of the
+     countdown. */
+  left = DIV_ROUND_UP (remaining, TICK_CYCLES);
+  if (left == 0)
+    left = 1;
+  ticks += oneshot_ticks - left;
+  thread_idle_skipped (oneshot_ticks - left);
+  oneshot_ticks = 1;
+  if (left > 1)
+    pit_configure_oneshot (0, remaining - (left - 1) * TICK_CYCLES);
+}
+
+/* Ends a one-shot countdown, during which SKIPPED ticks passed
+   without a timer interrupt, and restarts the periodic timer
+   interrupt.  The skipped ticks all end before the earliest
+   wake-up and before any MLFQS second boundary, so they need no
+   processing beyond being counted. */
+static void
+resume_periodic (int64_t skipped) 
+{
+  ASSERT (oneshot_ticks != 0);
+  ASSERT (skipped < oneshot_ticks);
+
+  oneshot_ticks = 0;
+  ticks += skipped;
+
+  /* After an early wake-up, the countdown's final tick may end
+     while another thread runs, but then SKIPPED is 0. */
+  if (skipped > 0)
+    thread_idle_skipped (skipped);
+  pit_configure_channel (0, 2, TIMER_FREQ);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -166,12 +315,50 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Wakes up every sleeping thread
+   whose wake-up tick has arrived.  Because sleep_list is sorted,
+   this only looks at the threads it wakes plus one more.  If one
+   of them outranks the running thread, it runs as soon as the
+   handler returns. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
+  /* A one-shot countdown ended: all but this tick were skipped.
+     If the countdown is still running, this is a periodic
+     interrupt that was already pending when it started. */
+  if (oneshot_ticks != 0)
+    {
+      bool expired;
+
+      pit_read_count (0, &expired);
+      if (expired)
+        resume_periodic (oneshot_ticks - 1);
+    }
   ticks++;
-  thread_tick ();
+
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+    }
+  thread_preempt ();
+
+  thread_tick ((args->cs & 3) == 3);
+}
+
+/* Returns true if the thread owning A wakes up before the
+   thread owning B.  Threads with equal wake-up ticks compare
+   equal, so list_insert_ordered() keeps them in FIFO order. */
+static bool
+wakeup_less (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  return (list_entry (a, struct thread, elem)->wakeup_tick
+          < list_entry (b, struct thread, elem)->wakeup_tick);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -0,0 +1,18 @@
+#ifndef __LIB_PROCSTAT_H
+#define __LIB_PROCSTAT_H
+
+#include <stdint.h>
+
+/* Per-process CPU accounting, as returned by the procstat()
+   system call.  Shared between the kernel and user programs. */
+struct procstat
+  {
+    int64_t user_ticks;              /* Timer ticks running user code. */
+    int64_t kernel_ticks;            /* Timer ticks running in kernel. */
+    int64_t blocked_ticks;           /* Timer ticks spent blocked. */
+    uint32_t voluntary_switches;     /* Switches away by blocking. */
+    uint32_t involuntary_switches;   /* Switches away by preemption. */
+    uint32_t yields;                 /* Switches away by thread_yield(). */
+  };
+
+#endif /* lib/procstat.h */
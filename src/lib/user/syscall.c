@@ -182,3 +182,9 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+procstat (pid_t pid, struct procstat *stats)
+{
+  return syscall2 (SYS_PROCSTAT, pid, stats);
+}
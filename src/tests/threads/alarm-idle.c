@@ -0,0 +1,71 @@
+/* Puts 1000 threads to sleep at once and checks that the CPU
+   stays almost entirely idle while they sleep.  A timer_sleep()
+   that yields in a loop instead of blocking keeps every sleeper
+   on the run queue, so the idle thread would never run. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of sleeping threads. */
+#define SLEEPER_CNT 1000
+
+/* Length of the measurement window, in ticks. */
+#define WINDOW (2 * TIMER_FREQ)
+
+/* Minimum percentage of the window that must be idle. */
+#define MIN_IDLE_PCT 90
+
+static thread_func sleeper;
+static int64_t wake_time;
+static struct semaphore done_sema;
+
+void
+test_alarm_idle (void) 
+{
+  int64_t start, idle_start, idle;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep for 10 seconds.", SLEEPER_CNT);
+  wake_time = timer_ticks () + 10 * TIMER_FREQ;
+  sema_init (&done_sema, 0);
+  for (i = 0; i < SLEEPER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper, NULL) == TID_ERROR)
+        fail ("couldn't create thread %d", i);
+    }
+
+  /* Let every sleeper reach timer_sleep(), then measure. */
+  timer_sleep (TIMER_FREQ / 2);
+  msg ("Measuring idle time for %d ticks.", WINDOW);
+  start = timer_ticks ();
+  idle_start = thread_idle_ticks ();
+  timer_sleep (WINDOW);
+  idle = thread_idle_ticks () - idle_start;
+  if (timer_ticks () >= wake_time)
+    fail ("sleepers woke up before the measurement finished");
+  if (idle * 100 < (timer_ticks () - start) * MIN_IDLE_PCT)
+    fail ("only %lld of %lld ticks were idle",
+          idle, timer_ticks () - start);
+  msg ("At least %d%% of the ticks were idle.", MIN_IDLE_PCT);
+
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&done_sema);
+  msg ("All sleepers woke up.");
+}
+
+static void
+sleeper (void *aux UNUSED) 
+{
+  timer_sleep (wake_time - timer_ticks ());
+  sema_up (&done_sema);
+}
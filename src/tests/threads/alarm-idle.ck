@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-idle) begin
+(alarm-idle) Creating 1000 threads to sleep for 10 seconds.
+(alarm-idle) Measuring idle time for 200 ticks.
+(alarm-idle) At least 90% of the ticks were idle.
+(alarm-idle) All sleepers woke up.
+(alarm-idle) end
+EOF
+pass;
@@ -0,0 +1,76 @@
+/* Checks that the tickless idle mode keeps time when the idle
+   CPU is woken early, before its timer countdown ends.
+
+   Writing to the serial port faster than it can transmit blocks
+   this thread, the only one running, until transmit interrupts
+   drain the queue, so the CPU goes idle with a one-shot timer
+   countdown that those interrupts keep cutting short.  Over that
+   time, timer_ticks() must keep pace with the processor's time
+   stamp counter, as calibrated against the periodic timer. */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "devices/timer.h"
+
+/* Number of ticks over which to calibrate the time stamp
+   counter against the periodic timer. */
+#define CALIBRATE_TICKS (TIMER_FREQ / 2)
+
+/* Number of lines of output to write while mostly idle. */
+#define LINE_CNT 32
+
+/* Maximum number of ticks that timer_ticks() may be off by, as
+   a percentage of the ticks that passed. */
+#define MAX_ERROR_PCT 10
+
+static int64_t next_tick (void);
+
+void
+test_alarm_tickless (void) 
+{
+  char line[64];
+  uint64_t start_tsc, tsc_per_tick;
+  int64_t start, elapsed, expected;
+  int i;
+
+  ASSERT (timer_tickless);
+
+  /* Measure the time stamp counter against the periodic timer.
+     This thread stays busy, so the CPU never goes idle. */
+  start = next_tick ();
+  start_tsc = trace_tsc ();
+  while (timer_elapsed (start) < CALIBRATE_TICKS)
+    continue;
+  tsc_per_tick = (trace_tsc () - start_tsc) / timer_elapsed (start);
+
+  /* Wait for the serial port with the CPU idle. */
+  memset (line, '.', sizeof line - 1);
+  line[sizeof line - 1] = '\0';
+  start = next_tick ();
+  start_tsc = trace_tsc ();
+  for (i = 0; i < LINE_CNT; i++)
+    msg ("%s", line);
+  elapsed = timer_elapsed (start);
+  expected = (trace_tsc () - start_tsc) / tsc_per_tick;
+
+  if (elapsed * 100 < expected * (100 - MAX_ERROR_PCT) - 100
+      || elapsed * 100 > expected * (100 + MAX_ERROR_PCT) + 100)
+    fail ("%"PRId64" ticks passed in %"PRId64" ticks of time",
+          elapsed, expected);
+  msg ("Timer kept time while idle.");
+}
+
+/* Busy-waits for the next timer tick and returns it. */
+static int64_t
+next_tick (void) 
+{
+  int64_t start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+  return timer_ticks ();
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($line) = '(alarm-tickless) ' . ('.' x 63) . "\n";
+check_expected ([
+  "(alarm-tickless) begin\n"
+  . ($line x 32)
+  . "(alarm-tickless) Timer kept time while idle.\n"
+  . "(alarm-tickless) end\n"]);
+pass;
@@ -0,0 +1,60 @@
+/* Tests that any number of readers can hold a reader-writer
+   lock at once.  The main thread holds the lock for reading
+   while three higher-priority threads acquire it for reading
+   too, each one keeping it until the main thread lets it go. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define READER_CNT 3
+
+static thread_func reader_thread;
+static struct rwlock rwlock;
+static struct semaphore done_sema;
+
+void
+test_rwlock_readers (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rwlock, "rwlock-readers");
+  sema_init (&done_sema, 0);
+
+  rwlock_acquire_read (&rwlock);
+  msg ("Main thread acquired the lock for reading.");
+  for (i = 0; i < READER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, PRI_DEFAULT + 1, reader_thread, NULL);
+    }
+  msg ("All readers hold the lock.");
+  if (rwlock_try_acquire_write (&rwlock))
+    fail ("Main thread acquired the lock for writing.");
+  msg ("Main thread could not acquire the lock for writing.");
+
+  for (i = 0; i < READER_CNT; i++)
+    sema_up (&done_sema);
+  rwlock_release_read (&rwlock);
+  msg ("Main thread released the lock.");
+
+  if (!rwlock_try_acquire_write (&rwlock))
+    fail ("Main thread could not acquire the free lock for writing.");
+  rwlock_release_write (&rwlock);
+}
+
+static void
+reader_thread (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rwlock);
+  msg ("Thread %s acquired the lock for reading.", thread_name ());
+  sema_down (&done_sema);
+  msg ("Thread %s releasing the lock.", thread_name ());
+  rwlock_release_read (&rwlock);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-readers) begin
+(rwlock-readers) Main thread acquired the lock for reading.
+(rwlock-readers) Thread reader 0 acquired the lock for reading.
+(rwlock-readers) Thread reader 1 acquired the lock for reading.
+(rwlock-readers) Thread reader 2 acquired the lock for reading.
+(rwlock-readers) All readers hold the lock.
+(rwlock-readers) Main thread could not acquire the lock for writing.
+(rwlock-readers) Thread reader 0 releasing the lock.
+(rwlock-readers) Thread reader 1 releasing the lock.
+(rwlock-readers) Thread reader 2 releasing the lock.
+(rwlock-readers) Main thread released the lock.
+(rwlock-readers) end
+EOF
+pass;
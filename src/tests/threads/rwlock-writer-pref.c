@@ -0,0 +1,61 @@
+/* Tests that a stream of readers cannot starve a writer.  While
+   the main thread holds a reader-writer lock for reading, a
+   writer starts waiting for it, and then three readers arrive.
+   The readers could share the lock with the main thread, but
+   must wait until the writer has had its turn.  Once it has,
+   they are admitted together, highest priority first. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define READER_CNT 3
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+static struct rwlock rwlock;
+
+void
+test_rwlock_writer_pref (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rwlock, "rwlock-writer-pref");
+
+  rwlock_acquire_read (&rwlock);
+  msg ("Main thread acquired the lock for reading.");
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread, NULL);
+  for (i = 0; i < READER_CNT; i++) 
+    {
+      int priority = PRI_DEFAULT + 2 + i;
+      char name[16];
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, priority, reader_thread, NULL);
+    }
+  msg ("Main thread releasing the lock.");
+  rwlock_release_read (&rwlock);
+  msg ("Main thread finished.");
+}
+
+static void
+reader_thread (void *aux UNUSED) 
+{
+  msg ("Thread %s acquiring the lock for reading.", thread_name ());
+  rwlock_acquire_read (&rwlock);
+  msg ("Thread %s acquired the lock for reading.", thread_name ());
+  rwlock_release_read (&rwlock);
+}
+
+static void
+writer_thread (void *aux UNUSED) 
+{
+  msg ("Thread %s acquiring the lock for writing.", thread_name ());
+  rwlock_acquire_write (&rwlock);
+  msg ("Thread %s acquired the lock for writing.", thread_name ());
+  rwlock_release_write (&rwlock);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-writer-pref) begin
+(rwlock-writer-pref) Main thread acquired the lock for reading.
+(rwlock-writer-pref) Thread writer acquiring the lock for writing.
+(rwlock-writer-pref) Thread reader 0 acquiring the lock for reading.
+(rwlock-writer-pref) Thread reader 1 acquiring the lock for reading.
+(rwlock-writer-pref) Thread reader 2 acquiring the lock for reading.
+(rwlock-writer-pref) Main thread releasing the lock.
+(rwlock-writer-pref) Thread writer acquired the lock for writing.
+(rwlock-writer-pref) Thread reader 2 acquired the lock for reading.
+(rwlock-writer-pref) Thread reader 1 acquired the lock for reading.
+(rwlock-writer-pref) Thread reader 0 acquired the lock for reading.
+(rwlock-writer-pref) Main thread finished.
+(rwlock-writer-pref) end
+EOF
+pass;
@@ -0,0 +1,64 @@
+/* Tests that a writer holds a reader-writer lock alone: while a
+   writer holds it, neither readers nor other writers get in, and
+   while a reader holds it, no writer gets in. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+static struct rwlock rwlock;
+static struct semaphore done_sema;
+
+void
+test_rwlock_writer (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rwlock, "rwlock-writer");
+  sema_init (&done_sema, 0);
+
+  rwlock_acquire_write (&rwlock);
+  msg ("Main thread acquired the lock for writing.");
+  thread_create ("reader", PRI_DEFAULT + 1, reader_thread, NULL);
+  thread_create ("writer", PRI_DEFAULT + 2, writer_thread, NULL);
+  msg ("Main thread releasing the lock.");
+  rwlock_release_write (&rwlock);
+
+  if (rwlock_try_acquire_read (&rwlock))
+    fail ("Main thread acquired the lock for reading.");
+  msg ("Main thread could not acquire the lock for reading.");
+  sema_up (&done_sema);
+
+  if (rwlock_try_acquire_write (&rwlock))
+    fail ("Main thread acquired the lock for writing.");
+  msg ("Main thread could not acquire the lock for writing.");
+  sema_up (&done_sema);
+  msg ("Main thread finished.");
+}
+
+static void
+reader_thread (void *aux UNUSED) 
+{
+  msg ("Thread %s acquiring the lock for reading.", thread_name ());
+  rwlock_acquire_read (&rwlock);
+  msg ("Thread %s acquired the lock for reading.", thread_name ());
+  sema_down (&done_sema);
+  msg ("Thread %s releasing the lock.", thread_name ());
+  rwlock_release_read (&rwlock);
+}
+
+static void
+writer_thread (void *aux UNUSED) 
+{
+  msg ("Thread %s acquiring the lock for writing.", thread_name ());
+  rwlock_acquire_write (&rwlock);
+  msg ("Thread %s acquired the lock for writing.", thread_name ());
+  sema_down (&done_sema);
+  msg ("Thread %s releasing the lock.", thread_name ());
+  rwlock_release_write (&rwlock);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-writer) begin
+(rwlock-writer) Main thread acquired the lock for writing.
+(rwlock-writer) Thread reader acquiring the lock for reading.
+(rwlock-writer) Thread writer acquiring the lock for writing.
+(rwlock-writer) Main thread releasing the lock.
+(rwlock-writer) Thread writer acquired the lock for writing.
+(rwlock-writer) Main thread could not acquire the lock for reading.
+(rwlock-writer) Thread writer releasing the lock.
+(rwlock-writer) Thread reader acquired the lock for reading.
+(rwlock-writer) Main thread could not acquire the lock for writing.
+(rwlock-writer) Thread reader releasing the lock.
+(rwlock-writer) Main thread finished.
+(rwlock-writer) end
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Child process run by procstat test.
+   Spins in user mode until a file named "done" appears. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-spin";
+
+/* Number of iterations between checks for "done". */
+#define SPIN_CNT 1000000
+
+int
+main (void) 
+{
+  for (;;) 
+    {
+      volatile int i;
+      int fd;
+
+      for (i = 0; i < SPIN_CNT; i++)
+        continue;
+      fd = open ("done");
+      if (fd != -1)
+        {
+          close (fd);
+          return 0;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+/* Runs a child process that spins in user mode and checks that
+   procstat() charges its CPU time to user mode, not to the
+   kernel, and counts its preemptions as involuntary switches. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of ticks of user time to let the child use. */
+#define USER_TICKS 20
+
+void
+test_main (void) 
+{
+  struct procstat stats;
+  pid_t child;
+
+  CHECK (!procstat (-1, &stats), "procstat(-1) must fail");
+  CHECK ((child = exec ("child-spin")) != -1, "exec \"child-spin\"");
+
+  do
+    if (!procstat (child, &stats))
+      fail ("procstat(child) failed");
+  while (stats.user_ticks < USER_TICKS);
+  msg ("child ran in user mode for %d ticks", USER_TICKS);
+
+  if (stats.kernel_ticks * 2 > stats.user_ticks)
+    fail ("child charged %lld kernel ticks but only %lld user ticks",
+          stats.kernel_ticks, stats.user_ticks);
+  if (stats.involuntary_switches == 0)
+    fail ("child was never preempted");
+  if (stats.yields != 0)
+    fail ("child yielded %u times", stats.yields);
+
+  CHECK (create ("done", 0), "create \"done\"");
+  CHECK (wait (child) == 0, "wait for child");
+}
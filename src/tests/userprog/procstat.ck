@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(procstat) begin
+(procstat) procstat(-1) must fail
+(procstat) exec "child-spin"
+(procstat) child ran in user mode for 20 ticks
+(procstat) create "done"
+(procstat) wait for child
+child-spin: exit(0)
+(procstat) end
+procstat: exit(0)
+EOF
+pass;
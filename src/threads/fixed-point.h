@@ -0,0 +1,74 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic.
+
+   The kernel cannot use floating point, so real numbers such as
+   the MLFQS load average are kept in an int whose low FP_SHIFT
+   bits hold the fraction.  Mixed operations take a fixed-point
+   number X and an integer N.  Products and quotients of two
+   fixed-point numbers are computed in 64 bits to avoid
+   overflowing the intermediate result. */
+typedef int fixed_t;
+
+#define FP_SHIFT 14                     /* Number of fraction bits. */
+#define FP_ONE (1 << FP_SHIFT)          /* 1.0 in fixed point. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t fp_from_int (int n) {
+  return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int fp_trunc (fixed_t x) {
+  return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int fp_round (fixed_t x) {
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + Y. */
+static inline fixed_t fp_add (fixed_t x, fixed_t y) {
+  return x + y;
+}
+
+/* Returns X - Y. */
+static inline fixed_t fp_sub (fixed_t x, fixed_t y) {
+  return x - y;
+}
+
+/* Returns X + N. */
+static inline fixed_t fp_add_int (fixed_t x, int n) {
+  return x + n * FP_ONE;
+}
+
+/* Returns X - N. */
+static inline fixed_t fp_sub_int (fixed_t x, int n) {
+  return x - n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_t fp_mul (fixed_t x, fixed_t y) {
+  return ((int64_t) x) * y / FP_ONE;
+}
+
+/* Returns X * N. */
+static inline fixed_t fp_mul_int (fixed_t x, int n) {
+  return x * n;
+}
+
+/* Returns X / Y. */
+static inline fixed_t fp_div (fixed_t x, fixed_t y) {
+  return ((int64_t) x) * FP_ONE / y;
+}
+
+/* Returns X / N. */
+static inline fixed_t fp_div_int (fixed_t x, int n) {
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -22,6 +22,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -37,6 +38,11 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -59,6 +65,7 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_feature (uint32_t feature);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -98,6 +105,10 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  trace_init ();
+#ifdef VM
+  frame_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -125,6 +136,10 @@ main (void)
   ide_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
+#ifdef VM
+  swap_init ();
+  frame_reclaim_init ();
+#endif
 #endif
 
   printf ("Boot complete.\n");
@@ -150,16 +165,39 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CPUID feature flags, in EDX for EAX=1.
+   See [IA32-v2a] "CPUID". */
+#define CPUID_PSE 0x00000008    /* Page size extensions. */
+#define CPUID_PGE 0x00002000    /* Page global enable. */
+
+/* CR4 flags.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x00000010      /* Page size extensions. */
+#define CR4_PGE 0x00000080      /* Page global enable. */
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, the kernel mappings are marked global,
+   so that their TLB entries survive CR3 reloads.  Every page
+   directory shares these page tables, and they never change, so
+   that is safe.
+
+   If the CPU supports PSE, each 4 MB region of physical memory
+   is mapped with a single large PDE, which needs no page table
+   and takes a single TLB entry.  Regions that contain kernel
+   text, which must be mapped read-only, and a partial region at
+   the end of memory still use 4 kB pages. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  bool global = cpu_has_feature (CPUID_PGE);
+  bool pse = cpu_has_feature (CPUID_PSE);
+  const size_t large_pages = PTSPAN / PGSIZE;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -171,6 +209,14 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0 && page + large_pages <= init_ram_pages
+          && !(&_start < vaddr + PTSPAN && vaddr < &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true) | (global ? PTE_G : 0);
+          page += large_pages - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -178,6 +224,22 @@ paging_init (void)
         }
 
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      if (global)
+        pt[pte_idx] |= PTE_G;
+    }
+
+  /* Large PDEs and global PTEs mean nothing to the CPU until
+     they are enabled in CR4.  The page tables that start.S set
+     up use neither, so it is safe to enable them first. */
+  if (pse || global) 
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      if (pse)
+        cr4 |= CR4_PSE;
+      if (global)
+        cr4 |= CR4_PGE;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
     }
 
   /* Store the physical address of the page directory into CR3
@@ -188,6 +250,17 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns true if the CPU has all of the given CPUID_* FEATURE
+   flags. */
+static bool
+cpu_has_feature (uint32_t feature) 
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & feature) == feature;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -256,9 +329,17 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-stack"))
+        page_stack_max = (size_t) atoi (value) * 1024 * 1024;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -381,8 +462,13 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
+          "  -trace             Record kernel events; dump to scratch device.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -stack=MB          Let user stacks grow to MB megabytes.\n"
 #endif
           );
   shutdown_power_off ();
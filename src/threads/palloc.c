@@ -2,13 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,13 +24,49 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free memory is
+   kept in blocks of 2**ORDER pages, each aligned to its size
+   relative to the base of the pool, on one free list per order.
+   A request is rounded up to a power of two, taken from the
+   smallest free block that is big enough, splitting it in halves
+   as needed, and the pages past the end of the request are freed
+   again.  Freeing a block merges it with its "buddy", the other
+   half of the block it was split from, for as long as the buddy
+   is free too.  Both take O(log n) time.
+
+   A free block's list element is stored in its first page.  The
+   free lists are protected by disabling interrupts, rather than
+   by a lock, because a dying thread's page is freed from the
+   scheduler.
+
+   In addition, the idle thread keeps up to ZEROED_MAX free pages
+   of each pool zeroed in advance (see palloc_zero_idle()), so
+   that a PAL_ZERO request for a single page does not have to
+   clear it on the caller's time.  These pages are off the free
+   lists, so when the free lists run dry they are given back. */
+
+/* Largest block: 2**MAX_ORDER pages. */
+#define MAX_ORDER 16
+
+/* Value of `orders' for a page that does not begin a free
+   block. */
+#define ORDER_NONE UINT8_MAX
+
+/* Maximum number of pre-zeroed pages in each pool. */
+#define ZEROED_MAX 32
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
+    uint8_t *orders;                    /* Order of free block at page. */
+    size_t page_cnt;                    /* Number of pages. */
+    size_t free_cnt;                    /* Pages on the free lists. */
+    struct list zeroed;                 /* Free pages, already zeroed. */
+    size_t zeroed_cnt;                  /* Number of pages in `zeroed'. */
+    struct bitmap *used_map;            /* Used pages, for cross-check. */
     uint8_t *base;                      /* Base of pool. */
   };
 
@@ -39,6 +76,26 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void release_zeroed (struct pool *);
+
+/* Returns the list element stored in the first page of the
+   block in POOL that starts at PAGE_IDX. */
+static inline struct list_elem *
+block_elem (const struct pool *pool, size_t page_idx) 
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the page in POOL that holds list element
+   E. */
+static inline size_t
+block_idx (const struct pool *pool, struct list_elem *e) 
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,15 +128,38 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  bool zeroed = false;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  if ((flags & PAL_ZERO) && page_cnt == 1 && !list_empty (&pool->zeroed))
+    {
+      page_idx = block_idx (pool, list_pop_front (&pool->zeroed));
+      pool->zeroed_cnt--;
+      zeroed = true;
+    }
+  else 
+    {
+      page_idx = alloc_pages (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+        {
+          release_zeroed (pool);
+          page_idx = alloc_pages (pool, page_cnt);
+        }
+    }
+#ifndef NDEBUG
+  if (page_idx != BITMAP_ERROR)
+    {
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+    }
+#endif
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -88,7 +168,10 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      /* A pre-zeroed page only needs its list element cleared. */
+      if (zeroed)
+        memset (pages, 0, sizeof (struct list_elem));
+      else if (flags & PAL_ZERO)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -118,6 +201,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +221,13 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
+#ifndef NDEBUG
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+#endif
+  free_pages (pool, page_idx, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +237,89 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool if PAL_USER
+   is set in FLAGS, otherwise in the kernel pool. */
+size_t
+palloc_count_free (enum palloc_flags flags) 
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = intr_disable ();
+  cnt = pool->free_cnt + pool->zeroed_cnt;
+  intr_set_level (old_level);
+  return cnt;
+}
+
+/* Zeroes one free page for later PAL_ZERO requests, taking it
+   from the kernel pool if it has fewer than ZEROED_MAX zeroed
+   pages, otherwise from the user pool.  Returns true if a page
+   was zeroed, false if both pools have enough or have no free
+   pages left.  Called by the idle thread with interrupts on, so
+   that it can be preempted while it clears the page. */
+bool
+palloc_zero_idle (void) 
+{
+  struct pool *pools[] = {&kernel_pool, &user_pool};
+  struct pool *pool = NULL;
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+  size_t i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    if (pools[i]->zeroed_cnt < ZEROED_MAX)
+      {
+        pool = pools[i];
+        page_idx = alloc_pages (pool, 1);
+        if (page_idx != BITMAP_ERROR)
+          break;
+      }
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  list_push_front (&pool->zeroed, block_elem (pool, page_idx));
+  pool->zeroed_cnt++;
+  intr_set_level (old_level);
+  return true;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
+  /* We'll put the pool's used_map and orders at its base.
+     Calculate the space needed for them and subtract it from
+     the pool's size.  (This overestimates a little, since the
+     pages they take up don't need entries of their own.) */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t meta_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
+  if (meta_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  /* Initialize the pool, then free all of its pages. */
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->orders = (uint8_t *) base + bm_size;
+  memset (p->orders, ORDER_NONE, page_cnt);
+  p->page_cnt = page_cnt;
+  p->free_cnt = 0;
+  p->base = base + meta_pages * PGSIZE;
+  free_pages (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +329,109 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is
+   big enough.  Interrupts must be off. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt) 
+{
+  int want, order;
+  size_t page_idx;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Round up to a power of two. */
+  for (want = 0; ((size_t) 1 << want) < page_cnt; want++)
+    if (want == MAX_ORDER)
+      return BITMAP_ERROR;
+
+  for (order = want; order <= MAX_ORDER; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order > MAX_ORDER)
+    return BITMAP_ERROR;
+
+  page_idx = block_idx (pool, list_pop_front (&pool->free_lists[order]));
+  pool->orders[page_idx] = ORDER_NONE;
+  pool->free_cnt -= (size_t) 1 << order;
+
+  /* Split off the upper halves that we don't need. */
+  while (order > want) 
+    {
+      size_t half_idx;
+
+      order--;
+      half_idx = page_idx + ((size_t) 1 << order);
+      pool->orders[half_idx] = order;
+      list_push_front (&pool->free_lists[order],
+                       block_elem (pool, half_idx));
+      pool->free_cnt += (size_t) 1 << order;
+    }
+
+  /* Give back the pages past the end of the request. */
+  free_pages (pool, page_idx + page_cnt,
+              ((size_t) 1 << want) - page_cnt);
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages in POOL starting at PAGE_IDX, which
+   need not form a single block, by breaking them up into the
+   largest aligned blocks that they contain.  Interrupts must be
+   off. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0) 
+    {
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free lists.
+   Interrupts must be off. */
+static void
+release_zeroed (struct pool *pool) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&pool->zeroed))
+    free_block (pool, block_idx (pool, list_pop_front (&pool->zeroed)), 0);
+  pool->zeroed_cnt = 0;
+}
+
+/* Frees the block of 2**ORDER pages in POOL starting at
+   PAGE_IDX, merging it with its buddy for as long as the buddy
+   is free as well.  Interrupts must be off. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  ASSERT (page_idx % ((size_t) 1 << order) == 0);
+
+  pool->free_cnt += (size_t) 1 << order;
+  while (order < MAX_ORDER) 
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy_idx >= pool->page_cnt || pool->orders[buddy_idx] != order)
+        break;
+      list_remove (block_elem (pool, buddy_idx));
+      pool->orders[buddy_idx] = ORDER_NONE;
+      page_idx &= ~((size_t) 1 << order);
+      order++;
+    }
+  pool->orders[page_idx] = order;
+  list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+}
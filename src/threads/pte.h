@@ -53,6 +53,11 @@ static inline uintptr_t pd_no (const void *va) {
 
    In a PDE, the physical address points to a page table.
    In a PTE, the physical address points to a data or code page.
+   A PDE with PTE_PS set is a "large" PDE: instead of pointing to
+   a page table, it maps a 4 MB page directly, and only bits
+   22:31 of its physical address are used.  Large PDEs require
+   CR4.PSE and are only used for the kernel's mapping of
+   physical memory.
    The important flags are listed below.
    When a PDE or PTE is not "present", the other flags are
    ignored.
@@ -66,6 +71,10 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /* 1=global, 0=per address space (PTEs and
+                                   4 MB PDEs only). */
+#define PDE_LARGE_ADDR 0xffc00000       /* Address bits of a large PDE. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,10 +82,25 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a large PDE that maps the 4 MB page starting at PAGE,
+   which must be aligned on a 4 MB boundary, for use by the
+   kernel only.  If WRITABLE is true then it will be writable. */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT (((uintptr_t) page & (PTSPAN - 1)) == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns true if PDE maps a 4 MB page rather than pointing to
+   a page table. */
+static inline bool pde_is_large (uint32_t pde) {
+  return (pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
 /* Returns a pointer to the page table that page directory entry
-   PDE, which must "present", points to. */
+   PDE, which must "present" and not large, points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
@@ -103,5 +127,11 @@ static inline void *pte_get_page (uint32_t pte) {
   return ptov (pte & PTE_ADDR);
 }
 
+/* Returns a pointer to the 4 MB page that large PDE points to. */
+static inline void *pde_get_large_page (uint32_t pde) {
+  ASSERT (pde_is_large (pde));
+  return ptov (pde & PDE_LARGE_ADDR);
+}
+
 #endif /* threads/pte.h */
 
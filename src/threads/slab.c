@@ -0,0 +1,212 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches, in the style of the kmem_cache allocator of
+   Bonwick's "The Slab Allocator".
+
+   Each cache allocates objects of one type out of slabs, single
+   pages obtained from the page allocator.  A slab begins with a
+   header, followed by the objects packed at their exact size
+   (rounded up only to a multiple of the word size).  The header
+   records which objects are free in a list of object indexes
+   kept apart from the objects themselves, so that a free object
+   keeps its contents.
+
+   That matters because of constructors.  An optional
+   constructor is run on every object once, when its slab is
+   created, instead of on every allocation.  Callers must return
+   objects to the cache in their constructed state, so that the
+   next allocation can use them without initializing them again.
+
+   A cache keeps its slabs on three lists: partially used, full
+   and empty.  Allocation takes from a partial slab if there is
+   one, then from an empty one, and only then creates a new
+   slab.  A slab that becomes empty is kept for reuse, but only
+   up to SLAB_EMPTY_MAX of them; beyond that, it is returned to
+   the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Marks the end of a slab's free list. */
+#define SLAB_END UINT16_MAX
+
+/* Number of empty slabs a cache keeps for reuse. */
+#define SLAB_EMPTY_MAX 1
+
+/* Slab header, at the beginning of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    size_t in_use;              /* Number of objects allocated. */
+    uint16_t free;              /* Index of first free object. */
+    uint16_t next[];            /* Next free object after each. */
+  };
+
+static struct slab *slab_create (struct kmem_cache *);
+static void *slab_object (struct kmem_cache *, struct slab *, size_t idx);
+
+/* Initializes cache C to hand out objects of SIZE bytes, naming
+   it NAME for debugging purposes.  If CTOR is nonnull, it is
+   called on each object before the object is first allocated.
+   Memory is not obtained until the first allocation, so this
+   may be called before the page allocator is initialized. */
+void
+kmem_cache_init (struct kmem_cache *c, const char *name, size_t size,
+                 void (*ctor) (void *))
+{
+  size_t n;
+
+  ASSERT (c != NULL);
+  ASSERT (size > 0 && size <= PGSIZE / 4);
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size, sizeof (uint32_t));
+  c->ctor = ctor;
+
+  /* Fit as many objects as possible after the header and its
+     free list. */
+  n = (PGSIZE - sizeof (struct slab)) / (c->obj_size + sizeof (uint16_t));
+  for (;;)
+    {
+      c->obj_ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                             sizeof (uint32_t));
+      if (c->obj_ofs + n * c->obj_size <= PGSIZE)
+        break;
+      n--;
+    }
+  ASSERT (n > 0 && n < SLAB_END);
+  c->objs_per_slab = n;
+
+  list_init (&c->partial);
+  list_init (&c->full);
+  list_init (&c->empty);
+  c->empty_cnt = 0;
+  lock_init_named (&c->lock, name);
+}
+
+/* Allocates and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else if (!list_empty (&c->empty))
+    {
+      s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+      c->empty_cnt--;
+      list_push_front (&c->partial, &s->elem);
+    }
+  else
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  /* Take the first free object. */
+  ASSERT (s->free != SLAB_END);
+  obj = slab_object (c, s, s->free);
+  s->free = s->next[s->free];
+  if (++s->in_use == c->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full, &s->elem);
+    }
+  lock_release (&c->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C and
+   must be in its constructed state, to C.  A null OBJ is
+   ignored. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  idx = ((uint8_t *) obj - (uint8_t *) s - c->obj_ofs) / c->obj_size;
+  ASSERT (obj == slab_object (c, s, idx));
+
+  lock_acquire (&c->lock);
+  ASSERT (s->in_use > 0);
+  s->next[idx] = s->free;
+  s->free = idx;
+  if (s->in_use-- == c->objs_per_slab)
+    {
+      /* No longer full. */
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  if (s->in_use == 0)
+    {
+      list_remove (&s->elem);
+      if (c->empty_cnt < SLAB_EMPTY_MAX)
+        {
+          list_push_front (&c->empty, &s->elem);
+          c->empty_cnt++;
+        }
+      else
+        {
+          s->magic = 0;
+          palloc_free_page (s);
+        }
+    }
+  lock_release (&c->lock);
+}
+
+/* Creates and returns a new slab for cache C, with all of its
+   objects free and constructed.  Returns a null pointer if no
+   page is available. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free = 0;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      s->next[i] = i + 1 < c->objs_per_slab ? i + 1 : SLAB_END;
+      if (c->ctor != NULL)
+        c->ctor (slab_object (c, s, i));
+    }
+  return s;
+}
+
+/* Returns object IDX in slab S of cache C. */
+static void *
+slab_object (struct kmem_cache *c, struct slab *s, size_t idx)
+{
+  return (uint8_t *) s + c->obj_ofs + idx * c->obj_size;
+}
@@ -0,0 +1,33 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object cache.
+
+   Hands out objects of a single type from pages of memory,
+   called slabs, that hold nothing but objects of that type, so
+   that, unlike malloc(), there is no rounding of sizes up to a
+   power of 2.  See slab.c for details. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for debugging. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    size_t obj_ofs;             /* Offset of first object in a slab. */
+    void (*ctor) (void *);      /* Constructor, or null. */
+    struct list partial;        /* Slabs with some objects in use. */
+    struct list full;           /* Slabs with every object in use. */
+    struct list empty;          /* Slabs with no objects in use. */
+    size_t empty_cnt;           /* Number of slabs in `empty'. */
+    struct lock lock;           /* Mutual exclusion. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      void (*ctor) (void *));
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+
+#endif /* threads/slab.h */
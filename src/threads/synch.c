@@ -27,10 +27,29 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "devices/timer.h"
+
+/* Lock contention profiling.
+
+   Each lock is tied, when it is initialized, to the lock_stats
+   record for its name.  Locks that share a name share a record,
+   so that, for example, the status locks of all the processes
+   that have ever run are reported together.  The table is
+   fixed-size; once it fills up, further names are counted under
+   a catch-all record. */
+#define LOCK_STATS_CNT 64
+static struct lock_stats lock_stats_table[LOCK_STATS_CNT];
+static size_t lock_stats_used;
+
+static struct lock_stats *lock_stats_get (const char *name);
+static void lock_stats_wait (struct lock_stats *, int64_t wait_start);
+static void lock_stats_hold (struct lock_stats *, int64_t hold_start);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -102,7 +121,10 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any (the longest-waiting one among equals).  If the
+   woken thread has a higher priority than the running
+   thread, the running thread yields to it.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +136,16 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters, thread_priority_less,
+                                      NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,20 +199,103 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   LOCK's contention statistics are reported under "unnamed".
+   Use lock_init_named() to give it a name of its own. */
 void
 lock_init (struct lock *lock)
+{
+  lock_init_named (lock, NULL);
+}
+
+/* Initializes LOCK like lock_init(), reporting its contention
+   statistics under NAME, which must remain valid for as long as
+   the kernel runs.  A null NAME is the same as lock_init(). */
+void
+lock_init_named (struct lock *lock, const char *name)
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN;
+  lock->stats = lock_stats_get (name);
+  lock->acquire_tick = 0;
   sema_init (&lock->semaphore, 1);
 }
 
+/* Maximum length of a chain of lock holders that a priority
+   donation is propagated through.  Bounds the time spent in
+   lock_acquire() when locks are nested deeply. */
+#define DONATION_DEPTH 8
+
+/* Donates PRIORITY to the holder of LOCK and, if that holder is
+   itself waiting for a lock, on down the chain of holders, for
+   at most DONATION_DEPTH locks.  Stops early once a lock already
+   carries a donation at least as high.  Interrupts must be
+   off. */
+static void
+donate_priority (struct lock *lock, int priority)
+{
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; depth < DONATION_DEPTH; depth++)
+    {
+      if (lock == NULL || lock->holder == NULL
+          || lock->max_priority >= priority)
+        break;
+      lock->max_priority = priority;
+      thread_donate_priority (lock->holder, priority);
+      lock = lock->holder->wait_lock;
+    }
+}
+
+/* Returns the highest priority among the threads waiting for
+   LOCK, or PRI_MIN if there are none.  Interrupts must be
+   off. */
+static int
+lock_waiters_max_priority (struct lock *lock)
+{
+  struct list *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (waiters))
+    return PRI_MIN;
+  return list_entry (list_max (waiters, thread_priority_less, NULL),
+                     struct thread, elem)->priority;
+}
+
+/* Makes the running thread the holder of LOCK and takes on the
+   donations of the threads still waiting for it.  Interrupts
+   must be off. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  lock->acquire_tick = timer_ticks ();
+  lock->stats->acquires++;
+  lock->max_priority = lock_waiters_max_priority (lock);
+  list_push_back (&cur->locks, &lock->lock_elem);
+  if (!thread_mlfqs)
+    thread_donate_priority (cur, lock->max_priority);
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   If the lock is held by a lower-priority thread, the current
+   thread donates its priority to the holder (and on through the
+   chain of holders the holder itself is waiting on) until the
+   lock is released.  Donation is disabled under the MLFQS.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +303,31 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  old_level = intr_disable ();
+  if (lock->holder != NULL)
+    {
+      int64_t wait_start = timer_ticks ();
+
+      trace_event (TRACE_LOCK_WAIT, (uint32_t) lock);
+      cur->wait_lock = lock;
+      if (!thread_mlfqs)
+        donate_priority (lock, cur->priority);
+      sema_down (&lock->semaphore);
+      cur->wait_lock = NULL;
+      trace_event (TRACE_LOCK_ACQUIRE, (uint32_t) lock);
+      lock_stats_wait (lock->stats, wait_start);
+    }
+  else
+    sema_down (&lock->semaphore);
+  lock_take (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +339,24 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    lock_take (lock);
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Priority donated through LOCK is withdrawn; donations through
+   other locks the thread still holds are kept.  If this leaves a
+   higher-priority thread ready, the current thread yields.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +364,18 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  lock_stats_hold (lock->stats, lock->acquire_tick);
   lock->holder = NULL;
+  list_remove (&lock->lock_elem);
+  thread_update_priority ();
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -246,13 +389,126 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+/* Returns the lock_stats record for NAME, creating it if
+   necessary.  A null NAME stands for "unnamed". */
+static struct lock_stats *
+lock_stats_get (const char *name)
+{
+  struct lock_stats *ls;
+  enum intr_level old_level;
+
+  if (name == NULL)
+    name = "unnamed";
+
+  old_level = intr_disable ();
+  for (ls = lock_stats_table; ls < lock_stats_table + lock_stats_used; ls++)
+    if (!strcmp (ls->name, name))
+      goto done;
+
+  if (lock_stats_used < LOCK_STATS_CNT - 1)
+    ls = &lock_stats_table[lock_stats_used++];
+  else 
+    {
+      ls = &lock_stats_table[LOCK_STATS_CNT - 1];
+      name = "others";
+    }
+  ls->name = name;
+
+ done:
+  intr_set_level (old_level);
+  return ls;
+}
+
+/* Records in LS a contended acquisition that started waiting at
+   tick WAIT_START and has just ended.  Interrupts must be off. */
+static void
+lock_stats_wait (struct lock_stats *ls, int64_t wait_start)
+{
+  int64_t wait = timer_ticks () - wait_start;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ls->contended++;
+  ls->wait_ticks += wait;
+  if (wait > ls->max_wait_ticks)
+    ls->max_wait_ticks = wait;
+}
+
+/* Records in LS a hold that started at tick HOLD_START and is
+   ending now.  Interrupts must be off. */
+static void
+lock_stats_hold (struct lock_stats *ls, int64_t hold_start)
+{
+  int64_t hold = timer_ticks () - hold_start;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (hold > ls->max_hold_ticks)
+    ls->max_hold_ticks = hold;
+}
+
+/* Returns true if lock_stats A has seen less contention than B,
+   comparing total wait time and then contended acquisitions. */
+static bool
+lock_stats_less (const struct lock_stats *a, const struct lock_stats *b)
+{
+  if (a->wait_ticks != b->wait_ticks)
+    return a->wait_ticks < b->wait_ticks;
+  return a->contended < b->contended;
+}
+
+/* Prints contention statistics for every lock name that has
+   been acquired at least once, most contended first. */
+void
+lock_print_stats (void) 
+{
+  struct lock_stats *sorted[LOCK_STATS_CNT];
+  size_t cnt = 0;
+  size_t i, j;
+
+  /* Insertion sort by decreasing contention. */
+  for (i = 0; i < lock_stats_used; i++)
+    {
+      struct lock_stats *ls = &lock_stats_table[i];
+      if (ls->acquires == 0)
+        continue;
+      for (j = cnt; j > 0 && lock_stats_less (sorted[j - 1], ls); j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = ls;
+      cnt++;
+    }
+  if (lock_stats_table[LOCK_STATS_CNT - 1].acquires != 0)
+    sorted[cnt++] = &lock_stats_table[LOCK_STATS_CNT - 1];
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct lock_stats *ls = sorted[i];
+      printf ("Lock %s: %llu acquires, %llu contended, "
+              "%"PRId64" wait ticks (max %"PRId64"), "
+              "max hold %"PRId64" ticks\n",
+              ls->name, ls->acquires, ls->contended,
+              ls->wait_ticks, ls->max_wait_ticks, ls->max_hold_ticks);
+    }
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on semaphore_elem A has
+   lower priority than the one waiting on B. */
+static bool
+waiter_priority_less (const struct list_elem *a, const struct list_elem *b,
+                      void *aux UNUSED)
+{
+  return (list_entry (a, struct semaphore_elem, elem)->thread->priority
+          < list_entry (b, struct semaphore_elem, elem)->thread->priority);
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,6 +551,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,8 +559,9 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one of them to
+   wake up from its wait.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,8 +575,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters, waiter_priority_less,
+                                      NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +598,200 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK, reporting its contention statistics under
+   NAME (see lock_init_named()).  A reader-writer lock may be
+   held either by any number of readers at once or by a single
+   writer.
+
+   Writers are preferred: once a writer is waiting, new readers
+   wait behind it, so a steady stream of readers cannot starve
+   writers.  When a writer releases the lock, another waiting
+   writer goes next if there is one; otherwise all waiting
+   readers are admitted together.  Among waiting writers, and
+   among waiting readers, the highest-priority thread is woken
+   first (see cond_signal()).
+
+   Like a lock, a reader-writer lock is not recursive: a thread
+   must not acquire it while already holding it. */
+void
+rwlock_init (struct rwlock *rwlock, const char *name)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init_named (&rwlock->lock, "rwlock internal");
+  cond_init (&rwlock->readers_ok);
+  cond_init (&rwlock->writers_ok);
+  rwlock->readers = 0;
+  rwlock->waiting_writers = 0;
+  rwlock->writer = NULL;
+  rwlock->stats = lock_stats_get (name);
+  rwlock->write_tick = 0;
+}
+
+/* Records an acquisition of RWLOCK in its statistics.  If the
+   acquiring thread had to wait, it started waiting at tick
+   WAIT_START.  RWLOCK's internal lock must be held. */
+static void
+rwlock_stats_acquire (struct rwlock *rwlock, bool waited, int64_t wait_start)
+{
+  enum intr_level old_level = intr_disable ();
+
+  rwlock->stats->acquires++;
+  if (waited)
+    lock_stats_wait (rwlock->stats, wait_start);
+  intr_set_level (old_level);
+}
+
+/* Acquires RWLOCK for reading, sleeping until no writer holds or
+   is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  int64_t wait_start = timer_ticks ();
+  bool waited = false;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writer != NULL || rwlock->waiting_writers > 0)
+    {
+      cond_wait (&rwlock->readers_ok, &rwlock->lock);
+      waited = true;
+    }
+  rwlock->readers++;
+  rwlock_stats_acquire (rwlock, waited, wait_start);
+  lock_release (&rwlock->lock);
+}
+
+/* Tries to acquire RWLOCK for reading and returns true if
+   successful or false if a writer holds or is waiting for it.
+   Does not wait for the lock to become available, although it
+   may sleep briefly on RWLOCK's internal lock, so it must not be
+   called within an interrupt handler. */
+bool
+rwlock_try_acquire_read (struct rwlock *rwlock)
+{
+  bool success;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->lock);
+  success = rwlock->writer == NULL && rwlock->waiting_writers == 0;
+  if (success)
+    {
+      rwlock->readers++;
+      rwlock_stats_acquire (rwlock, false, 0);
+    }
+  lock_release (&rwlock->lock);
+
+  return success;
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   reading.  The last reader out lets a waiting writer in. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0)
+    cond_signal (&rwlock->writers_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no reader or other
+   writer holds it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  int64_t wait_start = timer_ticks ();
+  bool waited = false;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->waiting_writers++;
+  while (rwlock->writer != NULL || rwlock->readers > 0)
+    {
+      cond_wait (&rwlock->writers_ok, &rwlock->lock);
+      waited = true;
+    }
+  rwlock->waiting_writers--;
+  rwlock->writer = thread_current ();
+  rwlock->write_tick = timer_ticks ();
+  rwlock_stats_acquire (rwlock, waited, wait_start);
+  lock_release (&rwlock->lock);
+}
+
+/* Tries to acquire RWLOCK for writing and returns true if
+   successful or false if it is held by any reader or writer.
+   Does not wait for the lock to become available, although it
+   may sleep briefly on RWLOCK's internal lock, so it must not be
+   called within an interrupt handler. */
+bool
+rwlock_try_acquire_write (struct rwlock *rwlock)
+{
+  bool success;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  success = rwlock->writer == NULL && rwlock->readers == 0;
+  if (success)
+    {
+      rwlock->writer = thread_current ();
+      rwlock->write_tick = timer_ticks ();
+      rwlock_stats_acquire (rwlock, false, 0);
+    }
+  lock_release (&rwlock->lock);
+
+  return success;
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   writing. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  enum intr_level old_level;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  old_level = intr_disable ();
+  lock_stats_hold (rwlock->stats, rwlock->write_tick);
+  intr_set_level (old_level);
+  rwlock->writer = NULL;
+  if (rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->writers_ok, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->readers_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing,
+   false otherwise.  (There is no way to tell whether a
+   particular thread holds it for reading.) */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return rwlock->writer == thread_current ();
+}
@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -17,19 +18,35 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Contention statistics shared by all locks with the same name. */
+struct lock_stats
+  {
+    const char *name;           /* Name given at initialization. */
+    unsigned long long acquires;        /* Successful acquisitions. */
+    unsigned long long contended;       /* Acquisitions that had to wait. */
+    int64_t wait_ticks;         /* Total timer ticks spent waiting. */
+    int64_t max_wait_ticks;     /* Longest single wait. */
+    int64_t max_hold_ticks;     /* Longest time held. */
+  };
+
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
-    struct list_elem lock_elem;
+    struct list_elem lock_elem; /* Element in holder's `locks' list. */
+    int max_priority;           /* Highest priority donated by a waiter. */
+    struct lock_stats *stats;   /* Contention statistics. */
+    int64_t acquire_tick;       /* Timer tick at which it was acquired. */
   };
 
 void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
@@ -42,6 +59,28 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock lock;                   /* Protects the members below. */
+    struct condition readers_ok;        /* Signaled when readers may enter. */
+    struct condition writers_ok;        /* Signaled when a writer may enter. */
+    unsigned readers;                   /* Number of readers holding it. */
+    unsigned waiting_writers;           /* Number of writers waiting. */
+    struct thread *writer;              /* Writer holding it, if any. */
+    struct lock_stats *stats;           /* Contention statistics. */
+    int64_t write_tick;                 /* Timer tick writer acquired it. */
+  };
+
+void rwlock_init (struct rwlock *, const char *name);
+void rwlock_acquire_read (struct rwlock *);
+bool rwlock_try_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
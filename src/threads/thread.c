@@ -11,6 +11,8 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/trace.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,9 +22,17 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one queue per priority, and bit P of ready_bitmap is
+   set if and only if ready_queues[P] is nonempty, so that both
+   adding a thread and finding the highest-priority ready thread
+   take constant time. */
+#define READY_WORD_BITS 32
+#define READY_WORDS ((PRI_MAX + READY_WORD_BITS) / READY_WORD_BITS)
+static struct list ready_queues[PRI_MAX + 1];
+static uint32_t ready_bitmap[READY_WORDS];
+static int ready_cnt;           /* # of threads in the run queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -37,6 +47,24 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+#ifdef USERPROG
+/* Cache of process structures.  A process is freed by whichever
+   of it and its parent goes last, so this is shared with
+   process.c. */
+struct kmem_cache process_cache;
+static void process_ctor (void *);
+#endif
+
+/* Pages of dead threads kept for reuse by thread_create(), so
+   that spawning a short-lived thread need not go through the
+   page allocator's lock, bitmap scan, and zeroing.  Only the
+   `struct thread' at the bottom of a reused page is
+   reinitialized; the stack area above it is left as is.
+   Accessed with interrupts off. */
+#define THREAD_PAGE_CACHE_SIZE 8
+static void *thread_page_cache[THREAD_PAGE_CACHE_SIZE];
+static size_t thread_page_cache_cnt;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -53,12 +81,17 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static bool yield_voluntary;    /* Is the thread in yield() yielding voluntarily? */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler. */
+#define MLFQS_PRI_TICKS 4       /* # of timer ticks between priority updates. */
+static fixed_t load_avg;        /* System load average. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -68,8 +101,19 @@ static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
+static void yield (bool voluntary);
 void thread_schedule_tail (struct thread *prev);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max (void);
+static void ready_queue_requeue (struct thread *, int priority);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static void mlfqs_update_priority (struct thread *, void *aux);
+static int mlfqs_priority (const struct thread *);
 static tid_t allocate_tid (void);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -87,10 +131,17 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  lock_init_named (&tid_lock, "tid");
+#ifdef USERPROG
+  kmem_cache_init (&process_cache, "process", sizeof (struct process),
+                   process_ctor);
+#endif
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -118,9 +169,12 @@ thread_start (void)
 }
 
 /* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+   Thus, this function runs in an external interrupt context.
+   USER is true if the interrupt came from user code; a user
+   process interrupted inside a system call or page fault is
+   charged kernel time. */
 void
-thread_tick (void) 
+thread_tick (bool user UNUSED) 
 {
   struct thread *t = thread_current ();
 
@@ -128,11 +182,20 @@ thread_tick (void)
   if (t == idle_thread)
     idle_ticks++;
 #ifdef USERPROG
-  else if (t->pagedir != NULL)
-    user_ticks++;
+  else if (user)
+    {
+      user_ticks++;
+      t->stats.user_ticks++;
+    }
 #endif
   else
-    kernel_ticks++;
+    {
+      kernel_ticks++;
+      t->stats.kernel_ticks++;
+    }
+
+  if (thread_mlfqs)
+    mlfqs_tick (t);
 
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
@@ -147,6 +210,58 @@ thread_print_stats (void)
           idle_ticks, kernel_ticks, user_ticks);
 }
 
+/* Returns the number of timer ticks spent in the idle thread
+   since boot. */
+int64_t
+thread_idle_ticks (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  int64_t t = idle_ticks;
+  intr_set_level (old_level);
+  return t;
+}
+
+/* Accounts for TICKS timer ticks that passed in the idle thread
+   without a timer interrupt, in tickless mode.  Called with
+   interrupts off. */
+void
+thread_idle_skipped (int64_t ticks) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (ticks == 0 || running_thread () == idle_thread);
+
+  idle_ticks += ticks;
+}
+
+/* Copies the CPU accounting of the thread with the given TID
+   into *STATS.  Time spent in a block that has not yet ended is
+   included.  Returns false if no such thread exists. */
+bool
+thread_get_procstat (tid_t tid, struct procstat *stats) 
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+  bool found = false;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      if (t->tid == tid)
+        {
+          *stats = t->stats;
+          if (t->status == THREAD_BLOCKED)
+            stats->blocked_ticks += timer_ticks () - t->block_start;
+          found = true;
+          break;
+        }
+    }
+  intr_set_level (old_level);
+
+  return found;
+}
+
 /* Creates a new kernel thread named NAME with the given initial
    PRIORITY, which executes FUNCTION passing AUX as the argument,
    and adds it to the ready queue.  Returns the thread identifier
@@ -159,9 +274,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, it is scheduled before thread_create() returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -178,7 +292,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -188,17 +302,16 @@ thread_create (const char *name, int priority,
 
 #ifdef USERPROG
   /* Allocate process info. */
-  p = malloc(sizeof(struct process));
+  p = kmem_cache_alloc (&process_cache);
   if (p == NULL)
     {
-      palloc_free_page (t);
+      free_thread_page (t);
       return TID_ERROR;
     }
   p->status = PROCESS_RUN;
   p->exit = -1;
   p->pid = tid;
   sema_init (&p->sema, 0);
-  lock_init (&p->status_lock);
 
   t->proc = p;
   list_init (&t->children);
@@ -227,8 +340,9 @@ thread_create (const char *name, int priority,
 
   intr_set_level (old_level);
 
-  /* Add to run queue. */
+  /* Add to run queue, and run it now if it outranks us. */
   thread_unblock (t);
+  thread_preempt ();
 
   return tid;
 }
@@ -266,7 +380,8 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  t->stats.blocked_ticks += timer_ticks () - t->block_start;
+  ready_queue_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -329,6 +444,24 @@ thread_exit (void)
    may be scheduled again immediately at the scheduler's whim. */
 void
 thread_yield (void) 
+{
+  yield (true);
+}
+
+/* Like thread_yield(), but for when the running thread is
+   forced to give up the CPU, at the end of its time slice or
+   because a higher-priority thread became ready.  The switch
+   counts as involuntary. */
+void
+thread_preempt_yield (void) 
+{
+  yield (false);
+}
+
+/* Yields the CPU, as a voluntary yield if VOLUNTARY is true or
+   as a preemption otherwise. */
+static void
+yield (bool voluntary) 
 {
   struct thread *cur = thread_current ();
   enum intr_level old_level;
@@ -337,8 +470,9 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_queue_push (cur);
   cur->status = THREAD_READY;
+  yield_voluntary = voluntary;
   schedule ();
   intr_set_level (old_level);
 }
@@ -360,11 +494,94 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  In an interrupt handler, the yield is
+   deferred until the handler returns. */
+void
+thread_preempt (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = ready_queue_max () > thread_current ()->priority;
+  intr_set_level (old_level);
+
+  if (preempt)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_preempt_yield ();
+    }
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY,
+   yielding if it no longer has the highest priority.  Priority
+   donated through locks the thread holds still applies.  Ignored
+   under the MLFQS, which computes priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+  thread_current ()->base_priority = new_priority;
+  thread_update_priority ();
+  thread_preempt ();
+}
+
+/* Recomputes the running thread's effective priority as the
+   highest of its base priority and the priorities donated
+   through each lock it holds.  Each lock caches its highest
+   donation, so this only walks the list of held locks.  Does not
+   yield; callers follow up with thread_preempt() if needed. */
+void
+thread_update_priority (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  struct list_elem *e;
+  int priority;
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  priority = cur->base_priority;
+  for (e = list_begin (&cur->locks); e != list_end (&cur->locks);
+       e = list_next (e))
+    {
+      struct lock *l = list_entry (e, struct lock, lock_elem);
+      if (l->max_priority > priority)
+        priority = l->max_priority;
+    }
+  cur->priority = priority;
+  intr_set_level (old_level);
+}
+
+/* Raises T's effective priority to PRIORITY if it is currently
+   lower, moving T to the matching run queue if it is ready.
+   Used by synch.c to donate priority to a lock holder. */
+void
+thread_donate_priority (struct thread *t, int priority) 
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  if (priority > t->priority)
+    ready_queue_requeue (t, priority);
+  intr_set_level (old_level);
+}
+
+/* Returns true if the thread owning list element A, which must
+   be a thread's `elem', has lower priority than that of B. */
+bool
+thread_priority_less (const struct list_elem *a, const struct list_elem *b,
+                      void *aux UNUSED) 
+{
+  return (list_entry (a, struct thread, elem)->priority
+          < list_entry (b, struct thread, elem)->priority);
 }
 
 /* Returns the current thread's priority. */
@@ -374,35 +591,52 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recalculates
+   its priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur, NULL);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (fp_mul_int (thread_current ()->recent_cpu,
+                                             100));
+  intr_set_level (old_level);
+  return recent_cpu_100;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -427,6 +661,21 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing to run: zero free pages ahead of time until a
+         thread becomes ready or there are enough of them.  This
+         is done with interrupts on, so that it can be
+         preempted. */
+      intr_enable ();
+      while (ready_cnt == 0 && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (ready_cnt > 0)
+        continue;
+
+      /* Still nothing to run: in tickless mode, don't take
+         another timer interrupt until the next timed wake-up. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -488,9 +737,27 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->locks);
+  t->block_start = timer_ticks ();
   t->magic = THREAD_MAGIC;
 
+  /* Under the MLFQS, the PRIORITY argument is ignored: a new
+     thread inherits its creator's nice and recent_cpu values and
+     its priority is computed from them. */
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = 0;
+  if (thread_mlfqs)
+    {
+      struct thread *parent = running_thread ();
+      if (parent != t && is_thread (parent))
+        {
+          t->nice = parent->nice;
+          t->recent_cpu = parent->recent_cpu;
+        }
+      t->priority = mlfqs_priority (t);
+    }
+
 #ifdef USERPROG
   list_init (&t->children);
   list_init (&t->files);
@@ -513,18 +780,163 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns the index of the most significant set bit in X, which
+   must be nonzero.  See [IA32-v2a] "BSR--Bit Scan Reverse". */
+static inline int
+bit_scan_reverse (uint32_t x)
+{
+  uint32_t idx;
+
+  ASSERT (x != 0);
+  asm ("bsrl %1, %0" : "=r" (idx) : "rm" (x));
+  return idx;
+}
+
+/* Adds T to the back of the run queue for its priority. */
+static void
+ready_queue_push (struct thread *t)
+{
+  int pri = t->priority;
+
+  list_push_back (&ready_queues[pri], &t->elem);
+  ready_bitmap[pri / READY_WORD_BITS] |= 1u << (pri % READY_WORD_BITS);
+  ready_cnt++;
+}
+
+/* Removes ready thread T from the run queue it is on.  T's
+   priority must not have changed since it was queued. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  int pri = t->priority;
+
+  ASSERT (t->status == THREAD_READY);
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[pri]))
+    ready_bitmap[pri / READY_WORD_BITS] &= ~(1u << (pri % READY_WORD_BITS));
+  ready_cnt--;
+}
+
+/* Changes T's priority to PRIORITY, moving T to the matching run
+   queue if it is ready. */
+static void
+ready_queue_requeue (struct thread *t, int priority)
+{
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Returns the highest priority of any ready thread, or -1 if no
+   thread is ready. */
+static int
+ready_queue_max (void)
+{
+  int word;
+
+  for (word = READY_WORDS - 1; word >= 0; word--)
+    if (ready_bitmap[word] != 0)
+      return word * READY_WORD_BITS + bit_scan_reverse (ready_bitmap[word]);
+  return -1;
+}
+
+/* Updates MLFQS statistics for timer tick in which T was
+   running.  Called with interrupts off from thread_tick().
+
+   recent_cpu and the load average are recomputed for every
+   thread once per second, which changes every priority.  In
+   between, only the running thread's recent_cpu changes, so the
+   priority recalculation every MLFQS_PRI_TICKS ticks is limited
+   to that thread instead of touching every thread. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  int64_t now = timer_ticks ();
+
+  if (t != idle_thread)
+    t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+  if (now % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_cnt + (t != idle_thread ? 1 : 0);
+
+      load_avg = fp_add (fp_mul (fp_div_int (fp_from_int (59), 60), load_avg),
+                         fp_div_int (fp_from_int (ready_threads), 60));
+      thread_foreach (mlfqs_update_recent_cpu, NULL);
+      thread_foreach (mlfqs_update_priority, NULL);
+    }
+  else if (now % MLFQS_PRI_TICKS == 0)
+    mlfqs_update_priority (t, NULL);
+  else
+    return;
+
+  thread_preempt ();
+}
+
+/* Decays T's recent_cpu according to the load average. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  fixed_t twice_load = fp_mul_int (load_avg, 2);
+  fixed_t decay = fp_div (twice_load, fp_add_int (twice_load, 1));
+
+  t->recent_cpu = fp_add_int (fp_mul (decay, t->recent_cpu), t->nice);
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+  if (t != idle_thread)
+    ready_queue_requeue (t, mlfqs_priority (t));
+}
+
+/* Returns the MLFQS priority for T, that is,
+   PRI_MAX - recent_cpu / 4 - nice * 2, clamped to the valid
+   range. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_trunc (fp_div_int (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   The thread chosen is the one at the front of the
+   highest-priority nonempty run queue, so threads of equal
+   priority are scheduled round-robin. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int pri = ready_queue_max ();
+  struct thread *t;
+
+  if (pri < 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  t = list_entry (list_front (&ready_queues[pri]), struct thread, elem);
+  ready_queue_remove (t);
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -552,6 +964,8 @@ thread_schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  if (prev != NULL)
+    trace_event (TRACE_SWITCH, prev->tid);
 
   /* Start new time slice. */
   thread_ticks = 0;
@@ -569,8 +983,63 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
+    }
+}
+
+/* Returns a page for a new thread, from the thread page cache if
+   possible and otherwise from the page allocator, or a null
+   pointer if no memory is available. */
+static struct thread *
+alloc_thread_page (void) 
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (thread_page_cache_cnt > 0)
+    t = thread_page_cache[--thread_page_cache_cnt];
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (PAL_ZERO);
+  return t;
+}
+
+#ifdef USERPROG
+/* Constructs process P in process_cache.  Its lock is released
+   before it is freed, so it only needs to be initialized once. */
+static void
+process_ctor (void *p_) 
+{
+  struct process *p = p_;
+
+  lock_init_named (&p->status_lock, "process status");
+}
+#endif
+
+/* Releases T's page, keeping it in the thread page cache if
+   there is room and returning it to the page allocator
+   otherwise. */
+static void
+free_thread_page (struct thread *t) 
+{
+  enum intr_level old_level;
+  bool cached = false;
+
+  /* Make stale pointers to T fail is_thread(). */
+  t->magic = 0;
+
+  old_level = intr_disable ();
+  if (thread_page_cache_cnt < THREAD_PAGE_CACHE_SIZE)
+    {
+      thread_page_cache[thread_page_cache_cnt++] = t;
+      cached = true;
     }
+  intr_set_level (old_level);
+
+  if (!cached)
+    palloc_free_page (t);
 }
 
 /* Schedules a new process.  At entry, interrupts must be off and
@@ -578,6 +1047,11 @@ thread_schedule_tail (struct thread *prev)
    running to some other state.  This function finds another
    thread to run and switches to it.
 
+   A switch away from a thread that blocked counts as voluntary
+   for that thread, one away from a thread that called
+   thread_yield() as a yield, and one away from a thread that
+   was preempted as involuntary.
+
    It's not safe to call printf() until thread_schedule_tail()
    has completed. */
 static void
@@ -591,8 +1065,20 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (cur == idle_thread)
+    timer_idle_exit ();
+  if (cur->status == THREAD_BLOCKED)
+    cur->block_start = timer_ticks ();
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      if (cur->status == THREAD_BLOCKED)
+        cur->stats.voluntary_switches++;
+      else if (cur->status == THREAD_READY && yield_voluntary)
+        cur->stats.yields++;
+      else if (cur->status == THREAD_READY)
+        cur->stats.involuntary_switches++;
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
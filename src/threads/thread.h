@@ -2,8 +2,12 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
+#include <procstat.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "filesys/file.h"
@@ -46,11 +50,21 @@ struct process
     int exit;                   /* Exit code of this process. */
   };
 
+#ifdef USERPROG
+/* Cache of process structures. */
+extern struct kmem_cache process_cache;
+#endif
+
 /* Thread priorities. */
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values, for the MLFQS. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice to other threads. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -103,10 +117,11 @@ struct process
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   semaphore wait list (synch.c) or the timer's sleep list
+   (devices/timer.c).  It can be used these ways only because
+   they are mutually exclusive: only a thread in the ready state
+   is on the run queue, whereas only a blocked thread is on a
+   semaphore wait list or the sleep list, and never on both. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -114,12 +129,20 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donation. */
+    int64_t wakeup_tick;                /* Tick to wake up at (timer.c). */
+    int nice;                           /* Niceness, for the MLFQS. */
+    fixed_t recent_cpu;                 /* Recent CPU time, for the MLFQS. */
+    struct procstat stats;              /* CPU time and switch counts. */
+    int64_t block_start;                /* Tick at which thread blocked. */
  
     struct list_elem allelem;           /* List element for all threads list. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct list locks;                  /* Locks held, for donation. */
+    struct lock *wait_lock;             /* Lock being waited for, if any. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -130,6 +153,16 @@ struct thread
     struct list files;                  /* Open file descriptors. */
     struct list children;               /* List of Child processes. */
     
+#endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, for demand paging. */
+    struct list mappings;               /* Memory-mapped files (mmap.c). */
+    int next_mapid;                     /* Next mapping identifier. */
+    void *user_esp;                     /* User esp at last kernel entry. */
+    void *fault_next;                   /* Next page of a sequential scan. */
+    size_t fault_window;                /* Pages to fault in at once. */
 #endif
  
     /* Owned by thread.c. */
@@ -144,8 +177,11 @@ extern bool thread_mlfqs;
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
 void thread_print_stats (void);
+int64_t thread_idle_ticks (void);
+void thread_idle_skipped (int64_t ticks);
+bool thread_get_procstat (tid_t, struct procstat *);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -159,6 +195,8 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+void thread_preempt_yield (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -167,6 +205,9 @@ void thread_foreach (thread_action_func *, void *);
 int thread_get_priority (void);
 void thread_set_priority (int);
 void thread_update_priority (void);
+void thread_donate_priority (struct thread *, int priority);
+bool thread_priority_less (const struct list_elem *,
+                           const struct list_elem *, void *aux);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -0,0 +1,141 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "devices/block.h"
+#endif
+
+/* If true, record events.  Set by the kernel command-line
+   option "-trace". */
+bool trace_enabled;
+
+/* Ring buffer of TRACE_CNT events, or a null pointer if events
+   are not being recorded. */
+struct trace_event *trace_buf;
+
+/* Number of events recorded so far.  The next event goes into
+   slot trace_next % TRACE_CNT. */
+uint32_t trace_next;
+
+/* Time at which recording started, for calibrating the time
+   stamp counter against timer ticks. */
+static uint64_t start_tsc;
+static int64_t start_ticks;
+
+#define TRACE_PAGES DIV_ROUND_UP (TRACE_CNT * sizeof (struct trace_event), \
+                                  PGSIZE)
+
+/* Starts recording events, if enabled.  Must be called after
+   palloc_init(). */
+void
+trace_init (void) 
+{
+  struct trace_event *buf;
+
+  if (!trace_enabled)
+    return;
+
+  buf = palloc_get_multiple (PAL_ZERO, TRACE_PAGES);
+  if (buf == NULL)
+    {
+      printf ("trace: no memory for %d-event buffer\n", TRACE_CNT);
+      return;
+    }
+  start_tsc = trace_tsc ();
+  start_ticks = timer_ticks ();
+  trace_buf = buf;
+}
+
+#ifdef FILESYS
+/* On-disk trace header, in the first sector of the scratch
+   device.  The events follow, starting at sector 1, in ring
+   buffer order; the oldest is in slot next % event_cnt. */
+struct trace_header
+  {
+    char magic[8];              /* "PINTRACE". */
+    uint32_t version;           /* Format version, currently 1. */
+    uint32_t event_size;        /* sizeof (struct trace_event). */
+    uint32_t event_cnt;         /* Number of slots in ring. */
+    uint32_t next;              /* Number of events recorded. */
+    uint64_t start_tsc;         /* TSC when recording started. */
+    uint64_t end_tsc;           /* TSC when recording stopped. */
+    int64_t start_ticks;        /* Timer ticks at start. */
+    int64_t end_ticks;          /* Timer ticks at stop. */
+    uint32_t timer_freq;        /* Timer ticks per second. */
+  };
+
+/* Stops recording and writes the recorded events to the scratch
+   block device.  Must be called with interrupts on, because
+   block I/O sleeps. */
+void
+trace_dump (void) 
+{
+  static uint8_t sector[BLOCK_SECTOR_SIZE];
+  struct trace_header *h = (struct trace_header *) sector;
+  struct trace_event *buf = trace_buf;
+  size_t buf_sectors = TRACE_CNT * sizeof *buf / BLOCK_SECTOR_SIZE;
+  struct block *scratch;
+  size_t i;
+
+  if (buf == NULL)
+    return;
+  trace_buf = NULL;
+
+  scratch = block_get_role (BLOCK_SCRATCH);
+  if (scratch == NULL)
+    {
+      printf ("trace: no scratch device, %"PRIu32" events discarded\n",
+              trace_next);
+      return;
+    }
+  if (block_size (scratch) < 1 + buf_sectors)
+    {
+      printf ("trace: scratch device %s too small for trace\n",
+              block_name (scratch));
+      return;
+    }
+  if (intr_get_level () != INTR_ON)
+    {
+      printf ("trace: interrupts off, trace not written\n");
+      return;
+    }
+
+  memset (sector, 0, sizeof sector);
+  memcpy (h->magic, "PINTRACE", sizeof h->magic);
+  h->version = 1;
+  h->event_size = sizeof *buf;
+  h->event_cnt = TRACE_CNT;
+  h->next = trace_next;
+  h->start_tsc = start_tsc;
+  h->end_tsc = trace_tsc ();
+  h->start_ticks = start_ticks;
+  h->end_ticks = timer_ticks ();
+  h->timer_freq = TIMER_FREQ;
+  block_write (scratch, 0, sector);
+  for (i = 0; i < buf_sectors; i++)
+    block_write (scratch, 1 + i, (uint8_t *) buf + i * BLOCK_SECTOR_SIZE);
+
+  printf ("trace: %"PRIu32" events written to %s\n",
+          trace_next < TRACE_CNT ? trace_next : TRACE_CNT,
+          block_name (scratch));
+  palloc_free_multiple (buf, TRACE_PAGES);
+}
+#else /* !FILESYS */
+/* Without block devices there is nowhere to write the trace, so
+   just stop recording. */
+void
+trace_dump (void) 
+{
+  if (trace_buf != NULL)
+    printf ("trace: no block devices, %"PRIu32" events discarded\n",
+            trace_next);
+  trace_buf = NULL;
+}
+#endif /* !FILESYS */
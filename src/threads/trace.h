@@ -0,0 +1,78 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Kernel event tracing.
+
+   When the kernel is started with -trace, timestamped binary
+   events are recorded into a fixed-size ring buffer, newest
+   overwriting oldest.  At shutdown the buffer is written to the
+   scratch block device, from which utils/pintos-trace decodes it
+   into a timeline. */
+
+/* Kinds of events. */
+enum trace_type
+  {
+    TRACE_SWITCH,               /* Context switch; ARG = previous tid. */
+    TRACE_SYSCALL,              /* System call entry; ARG = number. */
+    TRACE_SYSCALL_RETURN,       /* System call exit; ARG = eax. */
+    TRACE_PAGE_FAULT,           /* Page fault; ARG = fault address. */
+    TRACE_BLOCK_READ,           /* Block device read; ARG = sector. */
+    TRACE_BLOCK_WRITE,          /* Block device write; ARG = sector. */
+    TRACE_LOCK_WAIT,            /* Lock wait begins; ARG = lock address. */
+    TRACE_LOCK_ACQUIRE          /* Contended lock acquired; ARG = lock. */
+  };
+
+/* A recorded event.  The layout is known to utils/pintos-trace. */
+struct trace_event
+  {
+    uint64_t tsc;               /* Time stamp counter. */
+    uint16_t type;              /* One of enum trace_type. */
+    uint16_t tid;               /* Running thread. */
+    uint32_t arg;               /* Type-specific argument. */
+  };
+
+/* Number of events in the ring buffer.  Must be a power of 2. */
+#define TRACE_CNT 4096
+
+extern bool trace_enabled;
+extern struct trace_event *trace_buf;
+extern uint32_t trace_next;
+
+void trace_init (void);
+void trace_dump (void);
+
+/* Reads the processor's time stamp counter. */
+static inline uint64_t
+trace_tsc (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Records an event of the given TYPE with argument ARG, if
+   tracing is enabled.  Safe to call from any context: the slot
+   is claimed by a single xadd, which an interrupt cannot split
+   on a uniprocessor, so no locking is needed. */
+static inline void
+trace_event (enum trace_type type, uint32_t arg) 
+{
+  if (trace_buf != NULL) 
+    {
+      struct trace_event *e;
+      uint32_t slot = 1;
+
+      asm volatile ("xaddl %0, %1" : "+r" (slot), "+m" (trace_next));
+      e = &trace_buf[slot & (TRACE_CNT - 1)];
+      e->tsc = trace_tsc ();
+      e->type = type;
+      e->tid = thread_current ()->tid;
+      e->arg = arg;
+    }
+}
+
+#endif /* threads/trace.h */
@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -135,6 +139,7 @@ page_fault (struct intr_frame *f)
      [IA32-v3a] 5.15 "Interrupt 14--Page Fault Exception
      (#PF)". */
   asm ("movl %%cr2, %0" : "=r" (fault_addr));
+  trace_event (TRACE_PAGE_FAULT, (uint32_t) fault_addr);
 
   /* Turn interrupts back on (they were only off so that we could
      be assured of reading CR2 before it changed). */
@@ -148,6 +153,19 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* A fault in kernel context is on behalf of a system call, so
+     the process's esp is the one saved on entry to the kernel. */
+  if (user)
+    thread_current ()->user_esp = f->esp;
+
+  /* Bring in pages that have not been touched yet, and give a
+     page mapped to the shared zero page a frame of its own when
+     it is first written. */
+  if ((not_present || write) && page_load (fault_addr, write))
+    return;
+#endif
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
@@ -6,8 +6,13 @@
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* Invalidating more pages than this at once flushes the whole
+   TLB instead of invalidating each page with `invlpg'. */
+#define INVLPG_MAX 32
+
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_pages (uint32_t *, const void *, size_t page_cnt);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -52,7 +57,10 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR is mapped by a large (4 MB) PDE, returns a pointer to
+   that PDE instead, which callers may treat as a PTE except for
+   its address bits. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -80,11 +88,27 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  /* A large PDE maps VADDR itself, and its flags are laid out
+     like a PTE's, so it stands in for the PTE. */
+  if (pde_is_large (*pde))
+    {
+      ASSERT (!create);
+      return pde;
+    }
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
 }
 
+/* Returns true if PTE, as returned by lookup_page() for PD, is
+   really a large PDE in PD. */
+static inline bool
+is_large_pde (uint32_t *pd, uint32_t *pte) 
+{
+  return pte >= pd && pte < pd + PGSIZE / sizeof *pd;
+}
+
 /* Adds a mapping in page directory PD from user virtual page
    UPAGE to the physical frame identified by kernel virtual
    address KPAGE.
@@ -130,7 +154,9 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   ASSERT (is_user_vaddr (uaddr));
   
   pte = lookup_page (pd, uaddr, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
+  if (pte != NULL && is_large_pde (pd, pte))
+    return pde_get_large_page (*pte) + ((uintptr_t) uaddr & (PTSPAN - 1));
+  else if (pte != NULL && (*pte & PTE_P) != 0)
     return pte_get_page (*pte) + pg_ofs (uaddr);
   else
     return NULL;
@@ -152,8 +178,46 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_pages (pd, upage, 1);
+    }
+}
+
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+   present" in page directory PD, like pagedir_clear_page(), but
+   invalidates the TLB only once for all of them.  The pages need
+   not be mapped. */
+void
+pagedir_clear_range (uint32_t *pd, void *upage, size_t page_cnt) 
+{
+  bool cleared = false;
+  size_t i;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  for (i = 0; i < page_cnt; i++) 
+    {
+      void *vpage = (uint8_t *) upage + i * PGSIZE;
+      uint32_t *pte;
+
+      ASSERT (is_user_vaddr (vpage));
+      pte = lookup_page (pd, vpage, false);
+      if (pte != NULL && (*pte & PTE_P) != 0)
+        {
+          *pte &= ~PTE_P;
+          cleared = true;
+        }
     }
+  if (cleared)
+    invalidate_pages (pd, upage, page_cnt);
+}
+
+/* Returns true if virtual page VPAGE is present in PD and
+   writable by the user process, false otherwise. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
@@ -180,7 +244,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_pages (pd, vpage, 1);
         }
     }
 }
@@ -209,7 +273,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_pages (pd, vpage, 1);
         }
     }
 }
@@ -230,6 +294,20 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Makes PD the page directory for the running thread, loading
+   it into the CPU only if needed.  A null PD means that the
+   thread has no user address space.  The kernel half of every
+   page directory is the same, so such a thread can run on
+   whichever page directory is already loaded, and we leave it
+   there rather than flushing the TLB for nothing.  Likewise,
+   nothing is done if PD is already active. */
+void
+pagedir_switch (uint32_t *pd) 
+{
+  if (pd != NULL && pd != active_pd ())
+    pagedir_activate (pd);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
@@ -261,3 +339,23 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/* Invalidates the TLB entries for the PAGE_CNT pages starting at
+   VADDR if PD is the active page directory.  Each page is
+   invalidated with `invlpg', which leaves the rest of the TLB
+   intact, unless there are more than INVLPG_MAX of them, in
+   which case it is cheaper to flush the whole TLB.  See
+   [IA32-v2a] "INVLPG". */
+static void
+invalidate_pages (uint32_t *pd, const void *vaddr, size_t page_cnt) 
+{
+  size_t i;
+
+  if (page_cnt > INVLPG_MAX)
+    invalidate_pagedir (pd);
+  else if (active_pd () == pd)
+    for (i = 0; i < page_cnt; i++)
+      asm volatile ("invlpg (%0)"
+                    : : "r" ((const uint8_t *) vaddr + i * PGSIZE)
+                    : "memory");
+}
@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -18,6 +19,10 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 const uint8_t *USER_STACK_VADDR = (uint8_t *) PHYS_BASE - PGSIZE;
 static thread_func start_process NO_RETURN;
@@ -27,7 +32,9 @@ static void argument_tokenize (struct args_struct *args);
 static bool push_args_to_stack (struct args_struct *args, void **esp);
 static bool push_byte_to_stack (uint8_t val, void **esp);
 static bool push_word_to_stack (uint32_t val, void **esp);
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 struct process *get_child (pid_t pid);
 
 /* Returns child of current thread with given PID or NULL If non exists. */
@@ -82,7 +89,7 @@ process_execute (const char *args)
       if (child->status == PROCESS_FAIL)
         {
           list_remove (&child->elem);
-          free (child);
+          kmem_cache_free (&process_cache, child);
           return TID_ERROR;
         }
     }
@@ -154,7 +161,7 @@ process_wait (tid_t child_tid)
   sema_down (&child->sema);
   exit = child->exit;
   list_remove (&child->elem);
-  free (child);
+  kmem_cache_free (&process_cache, child);
   return exit;
 }
 
@@ -169,6 +176,7 @@ process_exit (void)
   struct list_elem *e;
   uint32_t *pd;
   int exit;
+  bool exited, orphaned;
 
   /* Remove open file descriptors. */
   while (!list_empty (&cur->files))
@@ -176,7 +184,7 @@ process_exit (void)
       e = list_pop_front (&cur->files);
       file_d = list_entry (e, struct file_descriptor, elem);
       file_close (file_d->file);
-      free (file_d);
+      kmem_cache_free (&file_descriptor_cache, file_d);
     }
 
   /* Destroy the current process's page directory and switch back
@@ -191,6 +199,10 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+#ifdef VM
+      mmap_unmap_all ();
+      page_table_destroy ();
+#endif
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -198,15 +210,20 @@ process_exit (void)
 
   /* Let the children of the process that they're now orphaned so they
      will clean up when they exit. */
-  for (e = list_end (&cur->children);e != list_begin (&cur->children);e = list_prev (e))
+  for (e = list_begin (&cur->children); e != list_end (&cur->children); )
     {
       child = list_entry (e, struct process, elem);
+      e = list_next (e);
       lock_acquire (&child->status_lock);
-      if (child->status != PROCESS_RUN)
-        free (child);
-      else 
+      exited = child->status != PROCESS_RUN;
+      if (!exited)
          child->status = PROCESS_ORPHAN;
       lock_release (&child->status_lock);
+
+      /* Freed objects go back to process_cache in their
+         constructed state, so the lock must be released first. */
+      if (exited)
+        kmem_cache_free (&process_cache, child);
     }
 
   /* Signal that we've exited to a waiting parent if there is one else
@@ -216,16 +233,13 @@ process_exit (void)
     {
       lock_acquire (&p->status_lock);
       exit = p->exit;
+      orphaned = p->status == PROCESS_ORPHAN;
       if (p->status == PROCESS_RUN) 
         p->status = PROCESS_DEAD;
-      else
-      if (p->status == PROCESS_ORPHAN)
-        {
-          free(p);
-          p = NULL;
-        }
       lock_release (&p->status_lock);
-      if (p != NULL)
+      if (orphaned)
+        kmem_cache_free (&process_cache, p);
+      else
         sema_up (&p->sema);
       printf ("%s: exit(%d)\n", cur->name, exit);
     }
@@ -239,8 +253,8 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables, if it has its own. */
+  pagedir_switch (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -336,6 +350,14 @@ load (struct args_struct *args_struct_ptr, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     return success;
+#ifdef VM
+  if (!page_table_init ())
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      return success;
+    }
+#endif
   process_activate ();
 
   /* Open executable file. */
@@ -349,7 +371,7 @@ load (struct args_struct *args_struct_ptr, void (**eip) (void), void **esp)
   else
     {
       file_deny_write (file);
-      file_d = malloc (sizeof (struct file_descriptor));
+      file_d = kmem_cache_alloc (&file_descriptor_cache);
       if (file_d == NULL)
         {
           file_close (file);
@@ -359,6 +381,14 @@ load (struct args_struct *args_struct_ptr, void (**eip) (void), void **esp)
       file_d->fd = t->fd;
       t->fd = t->fd + 1;
       list_push_back (&t->files, &file_d->elem);
+#ifdef VM
+      /* Pages are read from the executable on demand, so load
+         through a handle of our own that the user can't close. */
+      t->exec_file = file = file_reopen (file);
+      if (file == NULL)
+        return success;
+      file_deny_write (file);
+#endif
     }
 
   /* Read and verify executable header. */
@@ -523,6 +553,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table here and are read in by the page fault handler when
+   first touched.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -533,6 +567,23 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+
+      /* Advance. */
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -568,13 +619,30 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
 }
 
 
 
+/* Creates the user stack with the process's arguments on it
+   and stores the initial stack pointer into *ESP.  With VM, the
+   stack page is kept in the supplemental page table, so that it
+   can be swapped out like any other. */
 static bool
 setup_stack (struct args_struct *args_struct_ptr,void **esp) 
 {
+#ifdef VM
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  bool success;
+
+  /* Keep the page in memory while we write to it. */
+  if (!page_add_zero (upage, true) || !page_lock (upage, true))
+    return false;
+  *esp = PHYS_BASE;
+  success = push_args_to_stack (args_struct_ptr, esp);
+  page_unlock (upage);
+  return success;
+#else
   uint8_t *kpage;
   bool success_for_stack_page_allocation = false;
   bool success_for_setup_stack = false;
@@ -592,6 +660,7 @@ setup_stack (struct args_struct *args_struct_ptr,void **esp)
     }
    // hex_dump(*esp, *esp, (int) ((size_t) PHYS_BASE - (size_t) *esp), true);
   return (success_for_stack_page_allocation && success_for_setup_stack);
+#endif
 }
 
 /* Push arguments into the stack. */
@@ -655,6 +724,7 @@ push_word_to_stack (uint32_t val, void **esp)
   return true;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -674,4 +744,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
-
+#endif
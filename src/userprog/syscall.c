@@ -6,10 +6,16 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "filesys/file.h"
 #include <list.h>
 #include "threads/malloc.h"
+#include "userprog/pagedir.h"
 #include "devices/shutdown.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 #define ARG0 (*(esp + 1))
 #define ARG1 (*(esp + 2))
@@ -18,14 +24,21 @@
 #define ARG4 (*(esp + 5))
 #define ARG5 (*(esp + 6))
 
-struct lock file_lock;
+/* Serializes file system access.  Calls that only read files
+   hold it shared, so they can proceed in parallel. */
+struct rwlock file_lock;
+
+/* Cache of file descriptors. */
+struct kmem_cache file_descriptor_cache;
 
 static void syscall_handler (struct intr_frame *);
 
 void
 syscall_init (void) 
 {
-  lock_init(&file_lock);
+  rwlock_init (&file_lock, "file_lock");
+  kmem_cache_init (&file_descriptor_cache, "file descriptor",
+                   sizeof (struct file_descriptor), NULL);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -45,8 +58,108 @@ struct file *get_file(int fd)
 
 bool not_valid(const void *pointer)
 {
+#ifdef VM
+  /* Pages the process has not touched yet are valid too. */
+  return (pointer == NULL || !page_load (pointer, false));
+#else
   return (!is_user_vaddr(pointer) || pointer == NULL || pagedir_get_page (thread_current ()->pagedir, pointer) == NULL);
+#endif
+}
+
+/* Makes sure that the user page containing UADDR is present,
+   and writable if WRITE is true.  With VM, this also brings it
+   in and pins it. */
+static bool
+user_page_lock (const void *uaddr, bool write)
+{
+#ifdef VM
+  return page_lock (uaddr, write);
+#else
+  uint32_t *pd = thread_current ()->pagedir;
+  return (write
+          ? pagedir_is_writable (pd, uaddr)
+          : pagedir_get_page (pd, uaddr) != NULL);
+#endif
+}
+
+/* Unpins each user page from the one containing START up to,
+   but not including, END. */
+static void
+user_pages_unlock (const void *start UNUSED, const void *end UNUSED)
+{
+#ifdef VM
+  const uint8_t *page;
+
+  for (page = pg_round_down (start); page < (const uint8_t *) end;
+       page += PGSIZE)
+    page_unlock (page);
+#endif
+}
+
+/* Returns true if any byte from BUFFER to BUFFER + SIZE - 1 is
+   not valid.  Checks every page in between.  With VM, this also
+   brings them all in and pins them, so that the buffer can be
+   accessed while holding file_lock without faulting; the caller
+   must call buffer_unpin() when done with it.  If WRITE is
+   true, the kernel is going to write to the buffer, so every
+   page must also be writable.  An empty buffer is always
+   valid. */
+static bool
+buffer_not_valid (const void *buffer, unsigned size, bool write)
+{
+  const uint8_t *start = buffer;
+  const uint8_t *last = start + size - 1;
+  const uint8_t *page;
+
+  if (size == 0)
+    return false;
+  if (start == NULL || last < start || !is_user_vaddr (last))
+    return true;
+  for (page = pg_round_down (start); page <= last; page += PGSIZE)
+    if (!user_page_lock (page, write))
+      {
+        user_pages_unlock (start, page);
+        return true;
+      }
+  return false;
+}
+
+/* Unpins the pages of a buffer checked with buffer_not_valid(). */
+static void
+buffer_unpin (const void *buffer, unsigned size)
+{
+  if (size > 0)
+    user_pages_unlock (buffer, (const uint8_t *) buffer + size);
+}
+
+/* Returns true if null-terminated string STR is not valid.
+   Checks every page up to and including the one holding the
+   null terminator, and with VM pins them, as buffer_not_valid()
+   does.  Otherwise, stores the size of STR, including the null
+   terminator, in *SIZE, to be passed to buffer_unpin(). */
+static bool
+string_not_valid (const char *str, unsigned *size)
+{
+  const char *s;
+
+  if (str == NULL)
+    return true;
+  for (s = str; ; s++)
+    {
+      if ((s == str || pg_ofs (s) == 0)
+          && (!is_user_vaddr (s) || !user_page_lock (s, false)))
+        {
+          user_pages_unlock (str, s);
+          return true;
+        }
+      if (*s == '\0')
+        {
+          *size = s - str + 1;
+          return false;
+        }
+    }
 }
+
 void 
 halt (void)
 {
@@ -63,9 +176,14 @@ exit (int status)
 
 pid_t exec (const char *cmd_line)
 {
-  if (not_valid(cmd_line))
+  unsigned size;
+  pid_t pid;
+
+  if (string_not_valid (cmd_line, &size))
     exit (-1);
-  return process_execute(cmd_line); 
+  pid = process_execute(cmd_line);
+  buffer_unpin (cmd_line, size);
+  return pid;
 }
 
 int 
@@ -77,22 +195,27 @@ wait (pid_t pid)
 bool
 create(const char *file, unsigned initial_size)
 {
-  if (not_valid(file))
+  unsigned size;
+
+  if (string_not_valid (file, &size))
     exit (-1);
 
-  lock_acquire(&file_lock);
+  rwlock_acquire_write (&file_lock);
   bool result = filesys_create (file, initial_size);
-  lock_release(&file_lock);
+  rwlock_release_write (&file_lock);
+  buffer_unpin (file, size);
   return result;
 }
 
 bool
 remove (const char *file)
 {
-  if (not_valid(file))
+  unsigned size;
+
+  if (string_not_valid (file, &size))
     exit (-1);
 
-  lock_acquire(&file_lock);
+  rwlock_acquire_write (&file_lock);
   /* In case the file is opened. First check its existence. */
   struct file *f = filesys_open (file);
   bool result;
@@ -103,49 +226,56 @@ remove (const char *file)
       file_close (f);
       result = filesys_remove (file);
     }
-  lock_release(&file_lock);
+  rwlock_release_write (&file_lock);
+  buffer_unpin (file, size);
   return result;
 }
 
 int 
 open (const char *file)
 {
-  if (not_valid(file))
+  unsigned size;
+
+  if (string_not_valid (file, &size))
     exit (-1);
 
-  lock_acquire(&file_lock);
-  struct file_descriptor *file_d = malloc(sizeof(struct file_descriptor));
+  rwlock_acquire_write (&file_lock);
+  struct file_descriptor *file_d = kmem_cache_alloc (&file_descriptor_cache);
   struct file *f = filesys_open(file);
   struct thread *cur = thread_current();
-  if (f == NULL)
+  if (f == NULL || file_d == NULL)
     {
-      lock_release(&file_lock);
+      file_close (f);
+      kmem_cache_free (&file_descriptor_cache, file_d);
+      rwlock_release_write (&file_lock);
+      buffer_unpin (file, size);
       return -1;
     }
   file_d->file = f;
   file_d->fd = cur->fd;
   cur->fd = cur->fd + 1;
   list_push_back(&thread_current()->files,&file_d->elem);
-  lock_release(&file_lock);
+  rwlock_release_write (&file_lock);
+  buffer_unpin (file, size);
   return file_d->fd;
 }
 
 int
 filesize (int fd)
 {
-  lock_acquire(&file_lock);
+  rwlock_acquire_read (&file_lock);
   struct file *file = get_file(fd);
   int result = file ? file_length(file) : -1;
-  lock_release(&file_lock);
+  rwlock_release_read (&file_lock);
   return result;
 }
 
 int 
 read (int fd, void *buffer, unsigned size)
 {
-  if (not_valid(buffer) || not_valid(buffer+size) || fd == STDOUT_FILENO)
+  if (buffer_not_valid (buffer, size, true) || fd == STDOUT_FILENO)
     exit (-1);
-  lock_acquire(&file_lock);
+  rwlock_acquire_read (&file_lock);
   int count = 0, result = 0;
   if (fd == STDIN_FILENO)
     {
@@ -161,16 +291,17 @@ read (int fd, void *buffer, unsigned size)
       struct file *file = get_file(fd);
       result = file ? file_read(file, buffer, size) : -1;
     }
-  lock_release(&file_lock);
+  rwlock_release_read (&file_lock);
+  buffer_unpin (buffer, size);
   return result;
 }
 
 int 
 write (int fd, const void *buffer, unsigned size)
 {
-  if (not_valid(buffer) || not_valid(buffer+size) || fd == STDIN_FILENO)
+  if (buffer_not_valid (buffer, size, false) || fd == STDIN_FILENO)
     exit (-1);
-  lock_acquire(&file_lock);
+  rwlock_acquire_write (&file_lock);
   int result = 0;
   if (fd == STDOUT_FILENO)
     {
@@ -182,35 +313,72 @@ write (int fd, const void *buffer, unsigned size)
       struct file *file = get_file(fd);
       result = file? file_write(file, buffer, size) : -1;
     }
-  lock_release(&file_lock); 
+  rwlock_release_write (&file_lock); 
+  buffer_unpin (buffer, size);
   return result;
 }
 
 void 
 seek (int fd, unsigned position)
 {
-  lock_acquire(&file_lock);
+  rwlock_acquire_write (&file_lock);
   struct file *file = get_file(fd);
   if (file == NULL)
-    exit (-1);
+    {
+      rwlock_release_write (&file_lock);
+      exit (-1);
+    }
   file_seek(file,position);
-  lock_release(&file_lock);
+  rwlock_release_write (&file_lock);
 }
 
 unsigned 
 tell (int fd)
 {
-  lock_acquire(&file_lock);
+  rwlock_acquire_read (&file_lock);
   struct file *file = get_file(fd);
   int result = file ? file_tell(file) : 0;  
-  lock_release(&file_lock);
+  rwlock_release_read (&file_lock);
   return result;
 }
 
+bool
+procstat (pid_t pid, struct procstat *stats)
+{
+  struct procstat kstats;
+  bool found;
+
+  if (buffer_not_valid (stats, sizeof *stats, true))
+    exit (-1);
+  found = thread_get_procstat ((tid_t) pid, &kstats);
+  if (found)
+    *stats = kstats;
+  buffer_unpin (stats, sizeof *stats);
+  return found;
+}
+
+#ifdef VM
+mapid_t
+mmap (int fd, void *addr)
+{
+  struct file *file = get_file (fd);
+
+  if (file == NULL)
+    return MAP_FAILED;
+  return mmap_map (file, addr);
+}
+
+void
+munmap (mapid_t mapping)
+{
+  mmap_unmap (mapping);
+}
+#endif
+
 void 
 close (int fd)
 {
-  lock_acquire(&file_lock);
+  rwlock_acquire_write (&file_lock);
   struct list_elem *e;
   struct file_descriptor *file_d;  
   struct thread *cur;
@@ -224,19 +392,25 @@ close (int fd)
     {
       file_close (file_d->file);
       list_remove (&file_d->elem);
-      free (file_d); 
+      kmem_cache_free (&file_descriptor_cache, file_d);
       break;   
     }
   }
-  lock_release(&file_lock);
+  rwlock_release_write (&file_lock);
 }
 
 static void
 syscall_handler (struct intr_frame *f) 
 {
   uint32_t *esp = f->esp;
+#ifdef VM
+  /* Page faults taken on the process's behalf need this to
+     recognize stack accesses. */
+  thread_current ()->user_esp = f->esp;
+#endif
   if (not_valid(esp))
     exit (-1);
+  trace_event (TRACE_SYSCALL, *esp);
   switch (*esp)
     {
       case SYS_HALT:
@@ -279,10 +453,22 @@ syscall_handler (struct intr_frame *f)
       case SYS_CLOSE:
         close ((int) ARG0);
         break;
+#ifdef VM
+      case SYS_MMAP:
+        f->eax = mmap ((int) ARG0, (void *) ARG1);
+        break;
+      case SYS_MUNMAP:
+        munmap ((mapid_t) ARG0);
+        break;
+#endif
+      case SYS_PROCSTAT:
+        f->eax = procstat ((pid_t) ARG0, (struct procstat *) ARG1);
+        break;
       default:
         printf ("Invalid syscall!\n");
         thread_exit();
     }
+  trace_event (TRACE_SYSCALL_RETURN, f->eax);
 }
 
 
@@ -2,9 +2,14 @@
 #define USERPROG_SYSCALL_H
 
 #include "userprog/process.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include <stdbool.h>
 #include <stdint.h>
 
 void syscall_init (void);
 
+extern struct rwlock file_lock;
+extern struct kmem_cache file_descriptor_cache;
+
 #endif /* userprog/syscall.h */
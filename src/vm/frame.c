@@ -0,0 +1,623 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table: every frame of the user pool that holds a user
+   page, in the order that the clock hand sweeps them. */
+static struct list frames;
+
+/* Clock hand: the next frame to consider for eviction, or the
+   end of FRAMES to start over from the beginning. */
+static struct list_elem *hand;
+
+/* Where frame_evict_clean() resumes its scan, in the same form
+   as HAND. */
+static struct list_elem *clean_hand;
+
+/* Maximum number of frames frame_evict_clean() looks at. */
+#define CLEAN_SCAN_MAX 64
+
+/* Frames freed by a batched eviction and not yet reused. */
+static struct list spare_frames;
+
+/* Shared frames, keyed by inode and offset. */
+static struct hash shared_frames;
+
+/* A page of zeros, mapped read-only in place of every zero-fill
+   page that has been read but not yet written.  It comes from
+   the kernel pool and is never evicted. */
+static void *zero_kpage;
+
+/* Protects FRAMES, HAND, SPARE_FRAMES, SHARED_FRAMES, every
+   frame's pages and pin count, and the `frame' member of every
+   page that is in a frame.  It may be acquired while holding
+   file_lock, so no thread may wait for file_lock while holding
+   it; see page_evict().  It is not held during swap writes;
+   see swap_out_victims(). */
+static struct lock frame_lock;
+
+/* Signaled when frames being written to swap are done. */
+static struct condition io_done;
+
+/* Reclaim thread.
+
+   Evicting pages in the faulting thread makes the fault wait for
+   the clock scan and for any swap writes.  Instead, whenever the
+   number of free frames drops below LOW_WATER, frame_alloc()
+   wakes the reclaim thread, which evicts pages in the background
+   until HIGH_WATER frames are free again and puts their frames
+   in SPARE_FRAMES.  It prefers pages that can be dropped without
+   any I/O because they can be read back from a file.  A fault
+   evicts a page itself only if the reclaim thread falls
+   behind. */
+static struct condition reclaim_cond;   /* Signaled to start reclaim. */
+static size_t low_water, high_water;    /* Free frame watermarks. */
+
+static struct frame *frame_evict (void);
+static struct frame *frame_evict_clean (void);
+static void evict_shared (struct frame *);
+static bool frame_file_backed (struct frame *);
+static size_t free_frames (void);
+static thread_func reclaim_thread NO_RETURN;
+static bool frame_accessed (struct frame *, bool clear);
+static void swap_out_victims (struct frame *victims[], size_t cnt);
+static void wait_for_swap_out (struct page *);
+static void remove_frame (struct frame *);
+static void unshare (struct frame *);
+static void advance_hand (void);
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+
+/* Returns the page held in private frame F. */
+static inline struct page *
+frame_page (struct frame *f) 
+{
+  ASSERT (list_size (&f->pages) == 1);
+  return list_entry (list_front (&f->pages), struct page, frame_elem);
+}
+
+/* Initializes the frame table. */
+void
+frame_init (void) 
+{
+  list_init (&frames);
+  list_init (&spare_frames);
+  hand = clean_hand = list_end (&frames);
+  if (!hash_init (&shared_frames, share_hash, share_less, NULL))
+    PANIC ("frame_init: out of memory");
+  lock_init_named (&frame_lock, "frame table");
+  cond_init (&reclaim_cond);
+  cond_init (&io_done);
+  zero_kpage = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+
+  /* Keep about 3% to 6% of the user pool free, within limits. */
+  low_water = palloc_count_free (PAL_USER) / 32;
+  if (low_water > 32)
+    low_water = 32;
+  high_water = 2 * low_water;
+}
+
+/* Starts the reclaim thread.  Must be called after the thread
+   system and swap are up. */
+void
+frame_reclaim_init (void) 
+{
+  if (low_water > 0)
+    thread_create ("reclaim", PRI_DEFAULT, reclaim_thread, NULL);
+}
+
+/* Returns the kernel virtual address of the shared zero page,
+   which must never be written. */
+void *
+frame_zero_page (void) 
+{
+  return zero_kpage;
+}
+
+/* Returns true if a frame can be allocated without taking the
+   number of free frames below the low watermark, so that a page
+   can be brought in speculatively without causing any other
+   page to be evicted. */
+bool
+frame_plentiful (void) 
+{
+  bool plentiful;
+
+  lock_acquire (&frame_lock);
+  plentiful = free_frames () > low_water;
+  lock_release (&frame_lock);
+  return plentiful;
+}
+
+/* Obtains a frame to hold page P of the current thread, evicting
+   another page if the user pool is exhausted.  The frame is
+   returned pinned, so that P can be read into it safely; the
+   caller must unpin it with frame_unpin() when done.  Returns a
+   null pointer if no frame is available and none can be
+   evicted. */
+struct frame *
+frame_alloc (struct page *p) 
+{
+  struct frame *f = NULL;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  wait_for_swap_out (p);
+  if (!list_empty (&spare_frames))
+    {
+      f = list_entry (list_pop_front (&spare_frames), struct frame, elem);
+      list_insert (hand, &f->elem);
+    }
+  else 
+    {
+      kpage = palloc_get_page (PAL_USER);
+      if (kpage == NULL)
+        f = frame_evict ();
+      else
+        {
+          f = malloc (sizeof *f);
+          if (f == NULL)
+            palloc_free_page (kpage);
+          else
+            {
+              f->kpage = kpage;
+              list_insert (hand, &f->elem);
+            }
+        }
+    }
+
+  if (f != NULL)
+    {
+      list_init (&f->pages);
+      list_push_back (&f->pages, &p->frame_elem);
+      f->pin_cnt = 1;
+      f->in_flight = false;
+      f->inode = NULL;
+    }
+  if (free_frames () < low_water)
+    cond_signal (&reclaim_cond, &frame_lock);
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* If read-only file page P of the current thread is already in
+   a shared frame, adds P to that frame and returns it, pinned.
+   Otherwise, returns a null pointer. */
+struct frame *
+frame_attach (struct page *p) 
+{
+  struct frame key;
+  struct hash_elem *e;
+  struct frame *f = NULL;
+
+  key.inode = file_get_inode (p->file);
+  key.ofs = p->ofs;
+  key.read_bytes = p->read_bytes;
+  lock_acquire (&frame_lock);
+  e = hash_find (&shared_frames, &key.share_elem);
+  if (e != NULL)
+    {
+      f = hash_entry (e, struct frame, share_elem);
+      list_push_back (&f->pages, &p->frame_elem);
+      f->pin_cnt++;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Makes frame F, which has just been filled with read-only file
+   page P, available to frame_attach().  If another process has
+   loaded the same page in the meantime, F stays private. */
+void
+frame_share (struct frame *f, struct page *p) 
+{
+  lock_acquire (&frame_lock);
+  f->inode = file_get_inode (p->file);
+  f->ofs = p->ofs;
+  f->read_bytes = p->read_bytes;
+  if (hash_insert (&shared_frames, &f->share_elem) != NULL)
+    f->inode = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Removes page P from the frame holding it, freeing the frame
+   unless other processes share it.  The caller must have
+   removed P from its page directory and must hold a pin on the
+   frame, which is dropped. */
+void
+frame_release (struct page *p) 
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = p->frame;
+  ASSERT (f != NULL);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  list_remove (&p->frame_elem);
+  p->frame = NULL;
+  if (list_empty (&f->pages))
+    {
+      unshare (f);
+      remove_frame (f);
+      palloc_free_page (f->kpage);
+      free (f);
+    }
+  lock_release (&frame_lock);
+}
+
+/* Pins the frame holding page P, so that it will not be
+   evicted.  Returns true if successful, false if P is not in a
+   frame.  If P is being written to swap, waits for that to
+   finish, so that the caller sees P swapped out. */
+bool
+frame_pin (struct page *p) 
+{
+  bool success;
+
+  lock_acquire (&frame_lock);
+  wait_for_swap_out (p);
+  success = p->frame != NULL;
+  if (success)
+    p->frame->pin_cnt++;
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Undoes one pin of frame F. */
+void
+frame_unpin (struct frame *f) 
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Chooses a frame to evict with the second-chance clock
+   algorithm, evicts its pages and returns the frame for reuse.
+   Returns a null pointer if every frame is pinned or holds a
+   page that cannot be evicted.  FRAME_LOCK must be held.
+
+   A clean page is simply dropped.  Dirty pages are collected,
+   up to SWAP_BATCH of them, and written to swap together, so
+   that paging out costs one sequential burst per batch instead
+   of a scattered write per page; the frames beyond the first
+   are kept in SPARE_FRAMES for the next allocations.  FRAME_LOCK
+   is released while the batch is being written, so other
+   threads can fault and allocate frames in the meantime. */
+static struct frame *
+frame_evict (void) 
+{
+  struct frame *victims[SWAP_BATCH];
+  size_t victim_cnt = 0;
+  size_t tries;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  /* Two sweeps: the first may only clear accessed bits. */
+  for (tries = 2 * list_size (&frames); tries > 0; tries--)
+    {
+      struct frame *f;
+      bool dirty = false;
+
+      if (hand == list_end (&frames))
+        hand = list_begin (&frames);
+      if (hand == list_end (&frames))
+        break;
+      f = list_entry (hand, struct frame, elem);
+      advance_hand ();
+
+      if (f->pin_cnt > 0 || frame_accessed (f, true))
+        continue;
+      if (f->inode != NULL)
+        evict_shared (f);
+      else
+        {
+          struct page *p = frame_page (f);
+          if (!page_evict (p, p->thread->pagedir,
+                           swap_available () > victim_cnt, &dirty))
+            continue;
+          if (dirty)
+            {
+              /* Keep the clock from choosing it again. */
+              f->pin_cnt++;
+              victims[victim_cnt++] = f;
+              if (victim_cnt == SWAP_BATCH)
+                break;
+              continue;
+            }
+          list_remove (&p->frame_elem);
+          p->frame = NULL;
+        }
+
+      /* Clean pages cost nothing to evict: stop here. */
+      if (victim_cnt == 0)
+        return f;
+      remove_frame (f);
+      list_push_back (&spare_frames, &f->elem);
+      break;
+    }
+  if (victim_cnt == 0)
+    return NULL;
+
+  swap_out_victims (victims, victim_cnt);
+  for (i = 1; i < victim_cnt; i++)
+    {
+      remove_frame (victims[i]);
+      list_push_back (&spare_frames, &victims[i]->elem);
+    }
+  return victims[0];
+}
+
+/* Like frame_evict(), but only considers frames that hold
+   file-backed pages and only evicts them if they are clean (or
+   are memory-mapped pages that can be written back in place), so
+   that no swap is needed.
+
+   Unlike frame_evict(), this does not age pages: it takes only
+   frames whose pages have not been accessed since the clock hand
+   cleared their accessed bits, leaving the bits alone, so that
+   hot file pages keep their second chance.  It looks at no more
+   than CLEAN_SCAN_MAX frames per call, resuming where the last
+   call stopped.  FRAME_LOCK must be held. */
+static struct frame *
+frame_evict_clean (void) 
+{
+  size_t tries;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (tries = CLEAN_SCAN_MAX; tries > 0; tries--)
+    {
+      struct frame *f;
+      bool dirty;
+
+      if (clean_hand == list_end (&frames))
+        clean_hand = list_begin (&frames);
+      if (clean_hand == list_end (&frames))
+        break;
+      f = list_entry (clean_hand, struct frame, elem);
+      clean_hand = list_next (clean_hand);
+
+      if (f->pin_cnt > 0 || !frame_file_backed (f)
+          || frame_accessed (f, false))
+        continue;
+      if (f->inode != NULL)
+        evict_shared (f);
+      else
+        {
+          struct page *p = frame_page (f);
+          if (!page_evict (p, p->thread->pagedir, false, &dirty))
+            continue;
+          ASSERT (!dirty);
+          list_remove (&p->frame_elem);
+          p->frame = NULL;
+        }
+      return f;
+    }
+  return NULL;
+}
+
+/* Evicts all of the pages in shared frame F and removes F from
+   the share table.  FRAME_LOCK must be held. */
+static void
+evict_shared (struct frame *f) 
+{
+  ASSERT (f->inode != NULL);
+
+  while (!list_empty (&f->pages))
+    {
+      struct page *p = list_entry (list_pop_front (&f->pages),
+                                   struct page, frame_elem);
+      bool dirty;
+
+      /* Shared pages are read-only, so never dirty. */
+      page_evict (p, p->thread->pagedir, false, &dirty);
+      ASSERT (!dirty);
+      p->frame = NULL;
+    }
+  unshare (f);
+}
+
+/* Returns true if the pages in frame F can be read back from a
+   file after eviction. */
+static bool
+frame_file_backed (struct frame *f) 
+{
+  enum page_type type;
+
+  if (f->inode != NULL)
+    return true;
+  type = frame_page (f)->type;
+  return type == PAGE_FILE || type == PAGE_MMAP;
+}
+
+/* Returns the number of user frames that can be allocated
+   without evicting a page.  FRAME_LOCK must be held. */
+static size_t
+free_frames (void) 
+{
+  return palloc_count_free (PAL_USER) + list_size (&spare_frames);
+}
+
+/* Reclaim thread function.  Each time it is woken, evicts pages,
+   clean file-backed ones first, until HIGH_WATER frames are
+   free or nothing more can be evicted. */
+static void
+reclaim_thread (void *aux UNUSED) 
+{
+  lock_acquire (&frame_lock);
+  for (;;) 
+    {
+      cond_wait (&reclaim_cond, &frame_lock);
+      while (free_frames () < high_water) 
+        {
+          struct frame *f = frame_evict_clean ();
+          if (f == NULL)
+            f = frame_evict ();
+          if (f == NULL)
+            break;
+          remove_frame (f);
+          list_push_back (&spare_frames, &f->elem);
+
+          /* Let faulting threads at the frame table.  They run
+             at the same priority as we do, so releasing the lock
+             alone would not let them in before we took it back. */
+          lock_release (&frame_lock);
+          thread_yield ();
+          lock_acquire (&frame_lock);
+        }
+    }
+}
+
+/* Returns true if any page in frame F has been accessed since
+   the clock hand last passed.  If CLEAR is true, also clears
+   their accessed bits. */
+static bool
+frame_accessed (struct frame *f, bool clear) 
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->thread->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          if (clear)
+            pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Writes the pages in the CNT private frames in VICTIMS[], which
+   have been evicted from their page directories, to swap.  Sorts
+   them by owner and address first, so that neighbouring virtual
+   pages get neighbouring swap slots.
+
+   FRAME_LOCK must be held, but it is released during the writes.
+   Meanwhile the victims are marked in flight, and frame_alloc()
+   and frame_pin() wait for them before touching their pages. */
+static void
+swap_out_victims (struct frame *victims[], size_t cnt) 
+{
+  void *kpages[SWAP_BATCH];
+  size_t slots[SWAP_BATCH];
+  size_t i, j;
+
+  /* Insertion sort. */
+  for (i = 1; i < cnt; i++)
+    {
+      struct frame *f = victims[i];
+      struct page *p = frame_page (f);
+      for (j = i; j > 0; j--)
+        {
+          struct page *q = frame_page (victims[j - 1]);
+          if (q->thread < p->thread
+              || (q->thread == p->thread && q->upage < p->upage))
+            break;
+          victims[j] = victims[j - 1];
+        }
+      victims[j] = f;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      kpages[i] = victims[i]->kpage;
+      victims[i]->in_flight = true;
+    }
+  swap_alloc (cnt, slots);
+
+  /* The victims are pinned and out of their page directories, so
+     nothing else touches them until they are marked done. */
+  lock_release (&frame_lock);
+  swap_write (kpages, cnt, slots);
+  lock_acquire (&frame_lock);
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct page *p = frame_page (victims[i]);
+      page_swapped_out (p, slots[i]);
+      list_remove (&p->frame_elem);
+      p->frame = NULL;
+      victims[i]->in_flight = false;
+    }
+  cond_broadcast (&io_done, &frame_lock);
+}
+
+/* Waits until page P is not being written to swap.  FRAME_LOCK
+   must be held. */
+static void
+wait_for_swap_out (struct page *p) 
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  while (p->frame != NULL && p->frame->in_flight)
+    cond_wait (&io_done, &frame_lock);
+}
+
+/* Removes F from the frame table, moving the clock hands past it
+   if necessary. */
+static void
+remove_frame (struct frame *f) 
+{
+  if (hand == &f->elem)
+    advance_hand ();
+  if (clean_hand == &f->elem)
+    clean_hand = list_next (clean_hand);
+  list_remove (&f->elem);
+}
+
+/* Removes F from the share table, if it is there. */
+static void
+unshare (struct frame *f) 
+{
+  if (f->inode != NULL)
+    {
+      hash_delete (&shared_frames, &f->share_elem);
+      f->inode = NULL;
+    }
+}
+
+/* Moves the clock hand to the next frame. */
+static void
+advance_hand (void) 
+{
+  if (hand != list_end (&frames))
+    hand = list_next (hand);
+}
+
+/* Returns a hash value for the shared frame that E refers to. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct frame *f = hash_entry (e, struct frame, share_elem);
+  return hash_int ((int) f->inode ^ f->ofs ^ f->read_bytes);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+share_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  const struct frame *fa = hash_entry (a, struct frame, share_elem);
+  const struct frame *fb = hash_entry (b, struct frame, share_elem);
+  if (fa->inode != fb->inode)
+    return fa->inode < fb->inode;
+  if (fa->ofs != fb->ofs)
+    return fa->ofs < fb->ofs;
+  return fa->read_bytes < fb->read_bytes;
+}
@@ -0,0 +1,47 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct page;
+
+/* A physical frame from the user pool holding a user page.
+
+   Usually a frame holds a single page of a single process.  A
+   read-only page of an executable, however, is the same in
+   every process running that executable, so such a frame is
+   shared by all of them: it is keyed by the executable's inode
+   and the part of the file that the page holds, and holds the
+   page of every process that maps it. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address of frame. */
+    struct list pages;          /* Pages held in the frame. */
+    unsigned pin_cnt;           /* Exempt from eviction if nonzero. */
+    bool in_flight;             /* Being written to swap? */
+    struct list_elem elem;      /* Element in frame table. */
+
+    /* For shared frames. */
+    struct inode *inode;        /* Inode of file, or null if private. */
+    off_t ofs;                  /* Offset of page in file. */
+    size_t read_bytes;          /* Bytes read from file, rest zero. */
+    struct hash_elem share_elem;        /* Element in share table. */
+  };
+
+void frame_init (void);
+void frame_reclaim_init (void);
+bool frame_plentiful (void);
+struct frame *frame_alloc (struct page *);
+struct frame *frame_attach (struct page *);
+void frame_share (struct frame *, struct page *);
+void frame_release (struct page *);
+bool frame_pin (struct page *);
+void frame_unpin (struct frame *);
+void *frame_zero_page (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,132 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+
+static void unmap (struct mapping *);
+static void close_file (struct file *);
+
+/* Maps FILE into the current process's address space starting
+   at user page ADDR, through a handle of its own, so that
+   closing or removing FILE leaves the mapping intact.  Pages are
+   read from the file when first touched.  Returns the new
+   mapping's identifier, or MAP_FAILED if ADDR is not a nonzero
+   page-aligned address, FILE is empty, or the mapping would
+   overlap pages already in use. */
+mapid_t
+mmap_map (struct file *file, void *addr) 
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  rwlock_acquire_write (&file_lock);
+  m->file = file_reopen (file);
+  length = m->file != NULL ? file_length (m->file) : 0;
+  rwlock_release_write (&file_lock);
+  if (length == 0)
+    goto error;
+  m->base = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  /* The whole range must be unused user memory. */
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+      if (!is_user_vaddr (upage) || page_lookup (upage) != NULL)
+        goto error;
+    }
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mmap ((uint8_t *) addr + ofs, m->file, ofs, read_bytes))
+        {
+          while (i-- > 0)
+            page_remove ((uint8_t *) addr + i * PGSIZE);
+          goto error;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+
+ error:
+  close_file (m->file);
+  free (m);
+  return MAP_FAILED;
+}
+
+/* Unmaps the current process's mapping with identifier MAPID,
+   writing back any pages that were modified.  Does nothing if
+   there is no such mapping. */
+void
+mmap_unmap (mapid_t mapid) 
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        {
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Unmaps all of the current process's mappings. */
+void
+mmap_unmap_all (void) 
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_front (&t->mappings), struct mapping, elem));
+}
+
+/* Removes mapping M's pages, writing back the modified ones,
+   and frees M. */
+static void
+unmap (struct mapping *m) 
+{
+  size_t i;
+
+  /* Take the whole mapping out of the page directory first, so
+     that the TLB is flushed once instead of once per page.  The
+     dirty bits stay behind for page_remove() to check. */
+  pagedir_clear_range (thread_current ()->pagedir, m->base, m->page_cnt);
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove ((uint8_t *) m->base + i * PGSIZE);
+  close_file (m->file);
+  list_remove (&m->elem);
+  free (m);
+}
+
+/* Closes FILE, which may be null. */
+static void
+close_file (struct file *file) 
+{
+  rwlock_acquire_write (&file_lock);
+  file_close (file);
+  rwlock_release_write (&file_lock);
+}
@@ -0,0 +1,539 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* -stack: Maximum size of a user stack.  The stack grows a page
+   at a time, on demand, up to this size. */
+size_t page_stack_max = 8 * 1024 * 1024;
+
+/* Upper limit on the fault-around window, in pages. */
+#define FAULT_AROUND_MAX 16
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static bool page_add (void *upage, enum page_type, struct file *,
+                      off_t ofs, size_t read_bytes, bool writable);
+static struct page *page_find (const void *uaddr);
+static bool page_in (struct page *, bool write, bool pin);
+static bool page_is_backed (const struct page *);
+static void page_fault_around (struct page *);
+static bool page_read (struct page *, uint8_t *kpage);
+static void page_free (struct page *);
+static void page_write_back (struct page *);
+
+/* Initializes the current thread's supplemental page table.
+   Returns true if successful, false on memory allocation
+   failure. */
+bool
+page_table_init (void) 
+{
+  struct thread *t = thread_current ();
+
+  t->exec_file = NULL;
+  list_init (&t->mappings);
+  t->next_mapid = 0;
+  t->user_esp = PHYS_BASE;
+  t->fault_next = NULL;
+  t->fault_window = 1;
+  return hash_init (&t->pages, page_hash, page_less, NULL);
+}
+
+/* Destroys the current thread's supplemental page table, frees
+   the frames holding its pages and closes the executable it was
+   paging from. */
+void
+page_table_destroy (void) 
+{
+  struct thread *t = thread_current ();
+
+  hash_destroy (&t->pages, page_destroy);
+  if (t->exec_file != NULL)
+    {
+      rwlock_acquire_write (&file_lock);
+      file_close (t->exec_file);
+      rwlock_release_write (&file_lock);
+      t->exec_file = NULL;
+    }
+}
+
+/* Records that user page UPAGE is to be loaded on demand by
+   reading READ_BYTES bytes from FILE starting at offset OFS and
+   zeroing the rest of the page.  FILE must stay open for as
+   long as the page can be faulted in.  The page is writable by
+   the user process if WRITABLE is true, read-only otherwise.
+   Returns true if successful, false if UPAGE already has an
+   entry or memory allocation fails. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable) 
+{
+  return page_add (upage, read_bytes > 0 ? PAGE_FILE : PAGE_ZERO,
+                   file, ofs, read_bytes, writable);
+}
+
+/* Records that user page UPAGE is to be filled with zeros when
+   first touched.  Returns true if successful, false if UPAGE
+   already has an entry or memory allocation fails. */
+bool
+page_add_zero (void *upage, bool writable) 
+{
+  return page_add (upage, PAGE_ZERO, NULL, 0, 0, writable);
+}
+
+/* Records that user page UPAGE maps READ_BYTES bytes of FILE
+   starting at offset OFS, followed by zeros.  Unlike a page
+   added with page_add_file(), modifications are written back to
+   FILE, when the page is evicted or removed, instead of going
+   to swap.  Returns true if successful, false if UPAGE already
+   has an entry or memory allocation fails. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes) 
+{
+  return page_add (upage, PAGE_MMAP, file, ofs, read_bytes, true);
+}
+
+/* Removes the page containing UADDR from the current thread's
+   address space, writing it back first if it is a modified
+   memory-mapped page. */
+void
+page_remove (const void *uaddr) 
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (uaddr);
+
+  if (p != NULL)
+    {
+      hash_delete (&t->pages, &p->elem);
+      page_free (p);
+    }
+}
+
+/* Returns the current thread's supplemental page table entry
+   for the page containing UADDR, or a null pointer if there is
+   none. */
+struct page *
+page_lookup (const void *uaddr) 
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (&t->pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Makes the page containing user address UADDR present in the
+   current thread's page directory, loading it if it has not
+   yet been touched, and writable too if WRITE is true.  Returns
+   true if successful, false if UADDR is not part of the address
+   space, WRITE is true but the page is read-only, or memory for
+   it could not be obtained.
+
+   A zero-fill page that is only read is mapped to the shared
+   zero page; it gets a frame of its own on the first write.
+
+   Must not be called while holding file_lock, since loading a
+   page may read from the file system. */
+bool
+page_load (const void *uaddr, bool write) 
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  void *kpage;
+  bool backed;
+
+  if (t->pagedir == NULL || !is_user_vaddr (uaddr))
+    return false;
+
+  p = page_find (uaddr);
+  kpage = pagedir_get_page (t->pagedir, uaddr);
+  if (kpage != NULL && (!write || kpage != frame_zero_page ()))
+    return !write || (p != NULL && p->writable);
+  if (p == NULL || (write && !p->writable))
+    return false;
+
+  /* Keep P pinned while faulting around it, so that bringing in
+     its neighbours cannot evict it again. */
+  backed = page_is_backed (p);
+  if (!page_in (p, write, backed))
+    return false;
+  if (backed)
+    {
+      page_fault_around (p);
+      frame_unpin (p->frame);
+    }
+  return true;
+}
+
+/* Like page_load(), but also pins the page in its frame so that
+   it cannot be evicted until page_unlock() is called.  Kernel
+   code must lock user pages that it accesses while holding
+   file_lock, because faulting them back in would need the lock
+   again.  Returns false if the page cannot be loaded or if
+   WRITE is true but the page is read-only, since the kernel
+   must not write to a read-only page on the process's
+   behalf. */
+bool
+page_lock (const void *uaddr, bool write) 
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  if (t->pagedir == NULL || !is_user_vaddr (uaddr))
+    return false;
+
+  p = page_find (uaddr);
+  if (p == NULL)
+    return (write
+            ? pagedir_is_writable (t->pagedir, uaddr)
+            : pagedir_get_page (t->pagedir, uaddr) != NULL);
+  if (write && !p->writable)
+    return false;
+  return frame_pin (p) || page_in (p, true, true);
+}
+
+/* Unpins the page containing UADDR, which must have been locked
+   with page_lock(). */
+void
+page_unlock (const void *uaddr) 
+{
+  struct page *p = page_lookup (uaddr);
+
+  if (p != NULL && p->frame != NULL)
+    frame_unpin (p->frame);
+}
+
+/* Evicts page P, which is in a frame, from page directory PD,
+   so that its frame can be reused.  A modified memory-mapped
+   page is written back to its file.  Any other modified page
+   must go to swap, so if CAN_SWAP is false, returns false.
+   Otherwise, returns true and sets *DIRTY to whether the
+   contents must be written to swap, followed by a call to
+   page_swapped_out(), before the frame is reused.  Called by
+   the frame table with its lock held.
+
+   A thread that holds file_lock may go on to acquire the frame
+   table lock, so the frame table must never wait for file_lock.
+   A modified memory-mapped page is therefore only evicted if
+   file_lock can be acquired without waiting; otherwise, returns
+   false and the page stays in its frame until a later sweep. */
+bool
+page_evict (struct page *p, uint32_t *pd, bool can_swap, bool *dirty) 
+{
+  enum intr_level old_level;
+  bool locked;
+  bool evictable;
+
+  locked = p->type == PAGE_MMAP && rwlock_try_acquire_write (&file_lock);
+
+  /* Make sure that the owner can't dirty the page between our
+     check and removing it from its page directory. */
+  old_level = intr_disable ();
+  *dirty = pagedir_is_dirty (pd, p->upage);
+  evictable = !*dirty || (p->type == PAGE_MMAP ? locked : can_swap);
+  if (evictable)
+    pagedir_clear_page (pd, p->upage);
+  intr_set_level (old_level);
+
+  if (evictable && *dirty && p->type == PAGE_MMAP)
+    {
+      page_write_back (p);
+      *dirty = false;
+    }
+  if (locked)
+    rwlock_release_write (&file_lock);
+  if (!evictable)
+    return false;
+
+  if (*dirty && p->swap_slot != SWAP_SLOT_NONE)
+    {
+      /* A modified page's old swap copy is stale. */
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_SLOT_NONE;
+    }
+  return true;
+}
+
+/* Records that page P has been written to swap slot SLOT.  From
+   now on it is read back from there. */
+void
+page_swapped_out (struct page *p, size_t slot) 
+{
+  p->type = PAGE_SWAP;
+  p->swap_slot = slot;
+}
+
+/* Returns the current thread's supplemental page table entry
+   for the page containing UADDR, like page_lookup().  If there
+   is none but UADDR looks like an access to the user stack,
+   grows the stack to include it.  Otherwise, returns a null
+   pointer.
+
+   The stack grows only down to page_stack_max below PHYS_BASE,
+   and only for addresses no more than 32 bytes below the user
+   esp, since the PUSHA instruction checks access permissions
+   before adjusting the stack pointer. */
+static struct page *
+page_find (const void *uaddr) 
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (uaddr);
+  uint8_t *upage = pg_round_down (uaddr);
+
+  if (p == NULL
+      && (uint8_t *) uaddr >= (uint8_t *) t->user_esp - 32
+      && (size_t) ((uint8_t *) PHYS_BASE - upage) <= page_stack_max
+      && page_add_zero (upage, true))
+    p = page_lookup (upage);
+  return p;
+}
+
+/* Returns true if P's contents must be read from a file or from
+   swap, false if it is a zero-fill page. */
+static bool
+page_is_backed (const struct page *p) 
+{
+  return p->type != PAGE_ZERO;
+}
+
+/* Called after page P of the current thread has been faulted
+   in, to fault in the pages that follow it as well, so that a
+   process scanning memory sequentially takes fewer traps.
+
+   The number of pages brought in at once is adapted to the
+   access pattern: it doubles, up to FAULT_AROUND_MAX, each time
+   a fault lands just past the pages brought in by the previous
+   one, and halves on any other fault.  Only pages that must be
+   read from a file or swap are brought in early, and we stop at
+   the first page that is already present or cannot be read, or
+   as soon as free frames run low, so that reading ahead never
+   evicts a page that is already resident.  P must be pinned. */
+static void
+page_fault_around (struct page *p) 
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = p->upage;
+  size_t i;
+
+  if (upage == t->fault_next)
+    {
+      t->fault_window *= 2;
+      if (t->fault_window > FAULT_AROUND_MAX)
+        t->fault_window = FAULT_AROUND_MAX;
+    }
+  else if (t->fault_window > 1)
+    t->fault_window /= 2;
+
+  for (i = 1; i < t->fault_window; i++) 
+    {
+      uint8_t *next = upage + i * PGSIZE;
+      struct page *q;
+
+      if (!is_user_vaddr (next))
+        break;
+      q = page_lookup (next);
+      if (q == NULL || !page_is_backed (q) || !frame_plentiful ()
+          || pagedir_get_page (t->pagedir, next) != NULL
+          || !page_in (q, false, false))
+        break;
+    }
+  t->fault_next = upage + i * PGSIZE;
+}
+
+/* Obtains a frame for P, fills it with P's contents and maps
+   it in the current thread's page directory.  The frame is left
+   pinned if PIN is true.  Returns true if successful, false
+   otherwise.
+
+   A read-only page of a file is the same in every process that
+   maps it, so if another process already has it in a frame, P
+   just shares that frame.  Likewise, a zero-fill page that is
+   not about to be written or pinned is mapped read-only to the
+   shared zero page, without a frame, replacing that mapping
+   when it is written. */
+static bool
+page_in (struct page *p, bool write, bool pin) 
+{
+  struct thread *t = thread_current ();
+  bool shareable = p->type == PAGE_FILE && !p->writable;
+  struct frame *f;
+
+  if (pagedir_get_page (t->pagedir, p->upage) == frame_zero_page ())
+    pagedir_clear_page (t->pagedir, p->upage);
+  else if (p->type == PAGE_ZERO && !write && !pin)
+    return pagedir_set_page (t->pagedir, p->upage, frame_zero_page (),
+                             false);
+
+  /* If P is being evicted, these wait for that to finish. */
+  f = shareable ? frame_attach (p) : NULL;
+  if (f == NULL)
+    {
+      f = frame_alloc (p);
+      if (f == NULL)
+        return false;
+      if (!page_read (p, f->kpage))
+        goto error;
+      if (shareable)
+        frame_share (f, p);
+    }
+  ASSERT (p->frame == NULL);
+
+  if (!pagedir_set_page (t->pagedir, p->upage, f->kpage, p->writable))
+    goto error;
+  p->frame = f;
+  if (!pin)
+    frame_unpin (f);
+  return true;
+
+ error:
+  p->frame = f;
+  frame_release (p);
+  return false;
+}
+
+/* Fills KPAGE with the contents of page P.  Returns true if
+   successful, false on a file read error. */
+static bool
+page_read (struct page *p, uint8_t *kpage) 
+{
+  switch (p->type) 
+    {
+    case PAGE_FILE:
+    case PAGE_MMAP:
+      {
+        off_t n;
+
+        rwlock_acquire_read (&file_lock);
+        n = file_read_at (p->file, kpage, p->read_bytes, p->ofs);
+        rwlock_release_read (&file_lock);
+        if (n != (off_t) p->read_bytes)
+          return false;
+        memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      }
+      return true;
+
+    case PAGE_ZERO:
+      memset (kpage, 0, PGSIZE);
+      return true;
+
+    case PAGE_SWAP:
+      swap_in (p->swap_slot, kpage);
+      return true;
+
+    default:
+      NOT_REACHED ();
+    }
+}
+
+/* Adds an entry for user page UPAGE with the given attributes
+   to the current thread's supplemental page table.  Returns
+   true if successful, false if UPAGE already has an entry or
+   memory allocation fails. */
+static bool
+page_add (void *upage, enum page_type type, struct file *file,
+          off_t ofs, size_t read_bytes, bool writable) 
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->thread = t;
+  p->frame = NULL;
+  p->writable = writable;
+  p->type = type;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->swap_slot = SWAP_SLOT_NONE;
+  if (hash_insert (&t->pages, &p->elem) != NULL)
+    {
+      free (p);
+      return false;
+    }
+  return true;
+}
+
+/* Frees page P of the current thread, which must already have
+   been removed from its supplemental page table, along with its
+   frame and swap slot.  A modified memory-mapped page is written
+   back to its file first. */
+static void
+page_free (struct page *p) 
+{
+  uint32_t *pd = thread_current ()->pagedir;
+
+  /* Pinning keeps the page from being evicted while we look. */
+  if (frame_pin (p))
+    {
+      if (p->type == PAGE_MMAP && pagedir_is_dirty (pd, p->upage))
+        {
+          rwlock_acquire_write (&file_lock);
+          page_write_back (p);
+          rwlock_release_write (&file_lock);
+        }
+      pagedir_clear_page (pd, p->upage);
+      frame_release (p);
+    }
+  else if (pagedir_get_page (pd, p->upage) == frame_zero_page ())
+    pagedir_clear_page (pd, p->upage);
+  if (p->swap_slot != SWAP_SLOT_NONE)
+    swap_free (p->swap_slot);
+  free (p);
+}
+
+/* Writes memory-mapped page P, which is in a frame, back to its
+   file.  The caller must hold file_lock for writing. */
+static void
+page_write_back (struct page *p) 
+{
+  ASSERT (p->type == PAGE_MMAP);
+  ASSERT (p->frame != NULL);
+  ASSERT (rwlock_held_by_current_thread (&file_lock));
+
+  file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_int ((int) p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED) 
+{
+  const struct page *pa = hash_entry (a, struct page, elem);
+  const struct page *pb = hash_entry (b, struct page, elem);
+  return pa->upage < pb->upage;
+}
+
+/* Frees the page that E refers to. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED) 
+{
+  page_free (hash_entry (e, struct page, elem));
+}
@@ -0,0 +1,68 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct thread;
+
+/* Where a page's contents come from when it is first touched. */
+enum page_type
+  {
+    PAGE_FILE,                  /* Read from a file, zero the rest. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_MMAP,                  /* Memory-mapped part of a file. */
+    PAGE_SWAP                   /* In a swap slot. */
+  };
+
+/* Supplemental page table entry.
+
+   Describes one page of a process's virtual address space that
+   is not necessarily present in its page directory, so that
+   the page fault handler can bring it in on first touch. */
+struct page
+  {
+    void *upage;                /* User virtual page address. */
+    struct thread *thread;      /* Process the page belongs to. */
+    struct frame *frame;        /* Frame holding page, or null. */
+    struct list_elem frame_elem;        /* Element in frame's `pages'. */
+    bool writable;              /* Writable by the user process? */
+    enum page_type type;        /* Source of initial contents. */
+
+    /* For PAGE_FILE and PAGE_MMAP. */
+    struct file *file;          /* File to read. */
+    off_t ofs;                  /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest are zeroed. */
+
+    /* For PAGE_SWAP. */
+    size_t swap_slot;           /* Swap slot, or SWAP_SLOT_NONE. */
+
+    struct hash_elem elem;      /* Element in thread's `pages'. */
+  };
+
+/* Maximum size of a user stack, in bytes. */
+extern size_t page_stack_max;
+
+bool page_table_init (void);
+void page_table_destroy (void);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+void page_remove (const void *uaddr);
+struct page *page_lookup (const void *uaddr);
+bool page_load (const void *uaddr, bool write);
+bool page_lock (const void *uaddr, bool write);
+void page_unlock (const void *uaddr);
+bool page_evict (struct page *, uint32_t *pd, bool can_swap, bool *dirty);
+void page_swapped_out (struct page *, size_t slot);
+
+#endif /* vm/page.h */
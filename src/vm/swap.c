@@ -0,0 +1,154 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in a page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Swap device, or null if there is none. */
+static struct block *swap_device;
+
+/* Swap slots in use, one bit per page-sized slot. */
+static struct bitmap *swap_map;
+
+/* Number of free slots. */
+static size_t swap_free_cnt;
+
+/* Protects SWAP_MAP and SWAP_FREE_CNT. */
+static struct lock swap_lock;
+
+static size_t alloc_run (size_t cnt, size_t *slot);
+
+/* Initializes the swap manager.  Without a swap device, dirty
+   pages simply cannot be evicted. */
+void
+swap_init (void) 
+{
+  size_t slot_cnt;
+
+  lock_init_named (&swap_lock, "swap");
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    return;
+
+  slot_cnt = block_size (swap_device) / PAGE_SECTORS;
+  swap_map = bitmap_create (slot_cnt);
+  if (swap_map == NULL)
+    PANIC ("swap: bitmap creation failed");
+  swap_free_cnt = slot_cnt;
+}
+
+/* Returns the number of free swap slots. */
+size_t
+swap_available (void) 
+{
+  return swap_free_cnt;
+}
+
+/* Allocates CNT swap slots, which must be no more than
+   SWAP_BATCH, and stores them in SLOTS[].  The slots are taken
+   in runs of consecutive slots, as long as runs are free, so
+   that swap_write() can write them out to the disk in one pass.
+   The caller must have checked with swap_available() that there
+   are at least CNT free slots. */
+void
+swap_alloc (size_t cnt, size_t slots[]) 
+{
+  size_t i, j;
+
+  ASSERT (cnt <= SWAP_BATCH);
+  ASSERT (cnt <= swap_available ());
+
+  lock_acquire (&swap_lock);
+  for (i = 0; i < cnt; )
+    {
+      size_t slot;
+      size_t run = alloc_run (cnt - i, &slot);
+
+      for (j = 0; j < run; j++)
+        slots[i + j] = slot + j;
+      i += run;
+    }
+  lock_release (&swap_lock);
+}
+
+/* Writes the CNT pages at KPAGES[] to the swap slots in the
+   corresponding elements of SLOTS[], which were allocated by
+   swap_alloc(), in slot order.  Does not need any lock, so the
+   caller may drop its own locks around the writes. */
+void
+swap_write (void *kpages[], size_t cnt, const size_t slots[]) 
+{
+  size_t order[SWAP_BATCH];
+  size_t i, j;
+
+  ASSERT (cnt <= SWAP_BATCH);
+
+  /* A later, shorter run can lie below an earlier one, so sort
+     the pages by slot before writing them. */
+  for (i = 0; i < cnt; i++)
+    {
+      for (j = i; j > 0 && slots[order[j - 1]] > slots[i]; j--)
+        order[j] = order[j - 1];
+      order[j] = i;
+    }
+  for (i = 0; i < cnt; i++)
+    for (j = 0; j < PAGE_SECTORS; j++)
+      block_write (swap_device, slots[order[i]] * PAGE_SECTORS + j,
+                   (uint8_t *) kpages[order[i]] + j * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads the page in swap slot SLOT into KPAGE.  The slot stays
+   allocated, so that the page can be evicted again without
+   being rewritten if it is not modified. */
+void
+swap_in (size_t slot, void *kpage) 
+{
+  size_t i;
+
+  ASSERT (slot != SWAP_SLOT_NONE);
+  ASSERT (bitmap_test (swap_map, slot));
+
+  for (i = 0; i < PAGE_SECTORS; i++)
+    block_read (swap_device, slot * PAGE_SECTORS + i,
+                (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Frees swap slot SLOT. */
+void
+swap_free (size_t slot) 
+{
+  ASSERT (slot != SWAP_SLOT_NONE);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  bitmap_reset (swap_map, slot);
+  swap_free_cnt++;
+  lock_release (&swap_lock);
+}
+
+/* Allocates the longest run of free slots no longer than CNT,
+   which must be at least 1 and no more than the number of free
+   slots.  Stores the first slot in *SLOT and returns the length
+   of the run.  SWAP_LOCK must be held. */
+static size_t
+alloc_run (size_t cnt, size_t *slot) 
+{
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+  ASSERT (cnt > 0 && cnt <= swap_free_cnt);
+
+  for (;;) 
+    {
+      *slot = bitmap_scan_and_flip (swap_map, 0, cnt, false);
+      if (*slot != BITMAP_ERROR)
+        break;
+      cnt /= 2;
+      ASSERT (cnt > 0);
+    }
+  swap_free_cnt -= cnt;
+  return cnt;
+}
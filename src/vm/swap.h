@@ -0,0 +1,19 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/* Maximum number of pages written to swap in one burst. */
+#define SWAP_BATCH 8
+
+/* A swap slot that is not in use. */
+#define SWAP_SLOT_NONE ((size_t) -1)
+
+void swap_init (void);
+size_t swap_available (void);
+void swap_alloc (size_t cnt, size_t slots[]);
+void swap_write (void *kpages[], size_t cnt, const size_t slots[]);
+void swap_in (size_t slot, void *kpage);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */